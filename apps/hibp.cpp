@@ -1,172 +1,535 @@
-#include "os/algo.hpp"
-#include "os/bch.hpp"
-#include "os/str.hpp"
+#include "fmt/core.h"
+#include "hibp/compact.hpp"
+#include "hibp/count_index.hpp"
+#include "hibp/external_sort.hpp"
+#include "hibp/hibp.hpp"
+#include "hibp/range_server.hpp"
+#include "hibp/sha1_batch.hpp"
+#include "hibp/sharded.hpp"
+#include "hibp/spline_index.hpp"
+#include "hibp/update.hpp"
+#include "hibp/uring.hpp"
 #include "sha1/sha1.hpp"
-#include <array>
-#include <compare>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
-#include <ios>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include <random>
+#include <span>
 #include <stdexcept>
-#include <streambuf>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-namespace hibp {
-// unsigned because the next ops are likely bit-wise
-unsigned make_nibble(char nibblechr) {
-  int nibble = nibblechr - '0';
-  if (nibble > 9) nibble = (nibble & ~('a' - 'A')) - ('A' - '0') + 10; // NOLINT
-  assert(nibble >= 0 and nibble <= 15);                                // NOLINT decay
-  return static_cast<unsigned>(nibble);
+namespace {
+
+[[noreturn]] void usage(const std::string& prog) {
+  throw std::domain_error("USAGE:\n"
+                          "  " + prog + " build < hibp.txt > hibp.bin\n"
+                          "  " + prog + " build dbfile.bin [index_bits] [--counts] < hibp.txt\n"
+                          "  " + prog + " build-ntlm dbfile.bin [index_bits] [--counts]"
+                          " < hibp_ntlm.txt\n"
+                          "  " + prog + " build-sharded dbfile.bin shard_bits < hibp.txt\n"
+                          "  " + prog + " shard dbfile.bin shard_bits\n"
+                          "  " + prog + " sort dbfile.bin [memory_MB] < unsorted.txt\n"
+                          "  " + prog + " update dbfile.bin < sorted_delta.txt\n"
+                          "  " + prog + " export dbfile.bin > hibp.txt\n"
+                          "  " + prog + " verify dbfile.bin\n"
+                          "  " + prog + " index dbfile.bin [index_bits]\n"
+                          "  " + prog + " filter dbfile.bin\n"
+                          "  " + prog + " counts dbfile.bin\n"
+                          "  " + prog + " spline dbfile.bin [max_error]\n"
+                          "  " + prog + " eytzinger sorted.bin eytzinger.bin\n"
+                          "  " + prog + " compact dbfile.bin compact.bin [prefix_bytes]\n"
+                          "  " + prog + " search dbfile.bin plaintext_password [access]\n"
+                          "  " + prog + " csearch compact.bin plaintext_password [verify.bin]\n"
+                          "  " + prog + " batch dbfile.bin [access] < sha1_or_ntlm_hashes.txt\n"
+                          "  " + prog + " audit dbfile.bin [access] < plaintexts.txt\n"
+                          "  " + prog + " top dbfile.bin n [access]\n"
+                          "  " + prog + " above dbfile.bin min_count [access]\n"
+                          "  " + prog + " serve dbfile.bin [port [threads]]\n"
+                          "  " + prog + " bench dbfile.bin [lookups]\n"
+                          "access: --mmap | --pread | --uring, default is stream\n"
+                          "search, batch and verify use the shards of a sharded dbfile.bin,\n"
+                          "shard replaces dbfile.bin with its shards");
 }
 
-struct password {
-  password() = default;
+// optional --mmap, --pread or --uring flag at args[pos]
+hibp::access access_flag(const std::vector<std::string>& args, std::size_t pos) {
+  if (args.size() > pos && args[pos] == "--mmap") return hibp::access::mmap;
+  if (args.size() > pos && args[pos] == "--pread") return hibp::access::pread;
+  if (args.size() > pos && args[pos] == "--uring") return hibp::access::uring;
+  return hibp::access::stream;
+}
 
-  password(std::ifstream& db, std::size_t pos) { // NOLINT initialization
-    db.seekg(static_cast<long>(pos * sizeof(password)));
-    db.read(reinterpret_cast<char*>(this), sizeof(*this)); // NOLINT reinterpret_cast
+const char* access_name(hibp::access acc) {
+  switch (acc) {
+  case hibp::access::stream: return "stream";
+  case hibp::access::pread: return "pread";
+  case hibp::access::mmap: return "mmap";
+  case hibp::access::uring: return "uring";
   }
+  return "unknown";
+}
 
-  // line must be an upppercase sha1 hexstr with optional ":123" appended (123 is the count).
-  explicit password(const std::string& line) {   // NOLINT initlialisation
-    assert(line.length() >= hash.size() * 2);    // NOLINT decay
-    for (auto [i, b]: os::algo::enumerate(hash)) // note b is by reference!
-      b = static_cast<std::byte>(make_nibble(line[2 * i]) << 4U | make_nibble(line[2 * i + 1]));
-
-    if (line.size() > hash.size() * 2 + 1)
-      count = os::str::parse_nonnegative_int(line.c_str() + hash.size() * 2 + 1,
-                                             line.c_str() + line.size(), -1);
-    else
-      count = -1;
-  }
+unsigned index_bits(const std::vector<std::string>& args, std::size_t pos) {
+  return args.size() > pos && !args[pos].starts_with("--")
+             ? static_cast<unsigned>(std::stoul(args[pos]))
+             : hibp::prefix_index::default_bits;
+}
 
-  bool operator==(const password& rhs) const { return hash == rhs.hash; }
+bool has_flag(const std::vector<std::string>& args, const std::string& flag) {
+  return std::find(args.begin(), args.end(), flag) != args.end();
+}
 
-  std::strong_ordering operator<=>(const password& rhs) const { return hash <=> rhs.hash; }
+// sorted .bin of N byte hashes to dbfilename, with its .idx and, optionally, .cnt sidecars
+template <std::size_t N>
+void build_file(const std::vector<std::string>& args) {
+  std::ofstream os(args[2], std::ios::binary);
+  if (!os.is_open()) throw std::domain_error("cannot open `" + args[2] + "` for writing");
+  hibp::prefix_index                index(index_bits(args, 3));
+  std::optional<hibp::count_index> counts;
+  if (has_flag(args, "--counts")) counts.emplace();
+  hibp::build<N>(std::cin, os, &index, counts ? &*counts : nullptr);
+  index.save(hibp::prefix_index::sidecar_path(args[2]));
+  if (counts) counts->save(hibp::count_index::sidecar_path(args[2]));
+}
 
-  friend std::ostream& operator<<(std::ostream& os, const password& rhs) {
-    os << std::setfill('0') << std::hex << std::uppercase;
-    for (auto&& c: rhs.hash) os << std::setw(2) << static_cast<unsigned>(c);
-    os << std::dec << ":" << rhs.count;
-    return os;
-  }
+// Prints HASH:count for the n most common hashes, or all with count >= min, most common first.
+// Only those records, plus ~log2(records) for a threshold, are read from the db.
+template <std::size_t N>
+void ranked(const std::string& dbfilename, bool top, std::int64_t arg, hibp::db_options opts) {
+  hibp::basic_database<N> db(dbfilename, opts);
+  hibp::count_index       counts(hibp::count_index::sidecar_path(dbfilename));
 
-  std::array<std::byte, 20> hash;
-  int32_t                   count; // be definitive about size
-};
- 
-void build(std::istream& text_stream, std::ostream& binary_stream) {
-  // convert text file to binary. left here for future updates
-  // std::getline is about 2x faster than `is >> line` here
-
-  // Using std::fwrite is about 8x faster than std::ostream::write.
-  // But only if writing 1 password at a time. Instead buffer 100 of them.
-  constexpr std::size_t         obufcnt = 100;
-  std::array<password, obufcnt> obuf{};
-  std::size_t                   obufpos = 0;
-  for (std::string line; std::getline(text_stream, line);) {
-
-    password pw(line);
-    if (obufpos == obuf.size()) {
-      binary_stream.write(reinterpret_cast<char*>(&obuf), // NOLINT reincast
-                          static_cast<std::streamsize>(sizeof(password) * obuf.size()));
-      obufpos = 0;
+  auto pws = top ? counts.top(db, static_cast<std::size_t>(arg))
+                 : counts.at_least(db, static_cast<std::int32_t>(arg));
+  for (auto&& pw: pws) std::cout << pw << "\n";
+}
+
+// half existing records and half (almost certainly) absent random hashes
+std::vector<hibp::password> make_needles(hibp::database& db, std::size_t lookups) {
+  std::mt19937_64                            rgen(1); // NOLINT fixed seed
+  std::uniform_int_distribution<std::size_t> posdist(0, db.size() - 1);
+  std::uniform_int_distribution<unsigned>    bytedist(0, 255);
+
+  std::vector<hibp::password> needles(lookups);
+  for (std::size_t i = 0; i < lookups; ++i) {
+    if (i % 2 == 0) {
+      needles[i] = db.get(posdist(rgen));
+    } else {
+      for (auto& b: needles[i].hash) b = static_cast<std::byte>(bytedist(rgen));
     }
-    std::memcpy(&obuf[obufpos], &pw, sizeof(pw));
-    ++obufpos;
   }
-  if (obufpos > 0)
-    binary_stream.write(reinterpret_cast<char*>(&obuf), // NOLINT reincast
-                        static_cast<std::streamsize>(sizeof(password) * obufpos));
+  return needles;
+}
+
+// the hash type of a db, sharded or not
+hibp::hash_type db_type(const std::string& dbfilename) {
+  auto hdr = hibp::read_header(hibp::is_sharded(dbfilename) ? hibp::shard_path(dbfilename, 0)
+                                                             : std::filesystem::path(dbfilename));
+  return hdr ? hdr->type : hibp::hash_type::sha1;
 }
 
-class database {
-public:
-  explicit database(std::string dbfilename)
-      : dbfilename_(std::move(dbfilename)), dbpath_(dbfilename_),
-        dbfsize_(std::filesystem::file_size(dbpath_)), db_(dbpath_, std::ios::binary) {
+// One uppercase or lowercase hex hash per line, of the db's type. Prints HASH:count in input
+// order, with count 0 for hashes not found.
+template <std::size_t N, typename DB = hibp::basic_database<N>>
+void batch(const std::string& dbfilename, hibp::db_options opts) {
+  DB db(dbfilename, opts);
 
-    if (dbfsize_ % sizeof(password) != 0)
-      throw std::domain_error("db file size is not a multiple of the record size");
+  std::vector<hibp::basic_password<N>> needles;
+  for (std::string line; std::getline(std::cin, line);)
+    if (line.size() >= 2 * N) needles.emplace_back(line);
 
-    dbsize_ = dbfsize_ / sizeof(password);
+  auto results = db.search_batch(needles);
+  for (std::size_t i = 0; i < needles.size(); ++i) {
+    auto& pw = results[i] ? *results[i] : needles[i];
+    if (!results[i]) pw.count = 0;
+    std::cout << pw << "\n";
+  }
+}
 
-    if (!db_.is_open()) throw std::domain_error("cannot open db: " + std::string(dbpath_));
+// read the whole file once, so "warm" runs find every page in cache
+void warm_page_cache(const std::string& filename) {
+  std::ifstream     is(filename, std::ios::binary);
+  std::vector<char> buf(1U << 20U);
+  while (is.read(buf.data(), static_cast<std::streamsize>(buf.size()))) {
   }
+}
+
+void bench(const std::string& dbfilename, std::size_t lookups) {
+  constexpr std::size_t cold_lookups = 1'000; // beyond this the top of the tree is cached again
 
-  std::optional<password> search(password needle) {
-    std::size_t count = dbsize_;
-    std::size_t first = 0;
-    // lower_bound binary search algo
-    while (count > 0) {
-      std::size_t pos  = first;
-      std::size_t step = count / 2;
-      pos += step;
-      password cur(db_, pos);
-      if (cur < needle) { // NOLINT weird nullptr warning
-        first = ++pos;
-        count -= step + 1;
-      } else
-        count = step;
+  std::vector<hibp::password> needles;
+  hibp::layout                layout{};
+  {
+    hibp::database db(dbfilename);
+    if (db.size() == 0) throw std::domain_error("db is empty");
+    needles = make_needles(db, lookups);
+    layout  = db.get_layout();
+  }
+
+  auto run = [&](const std::string& name, hibp::db_options opts, bool cold) {
+    std::span<const hibp::password> batch = needles;
+    if (cold) {
+      hibp::evict_page_cache(dbfilename);
+      batch = batch.first(std::min(batch.size(), cold_lookups));
+    }
+    hibp::database db(dbfilename, opts);
+    std::size_t    found = 0;
+    auto           start = std::chrono::steady_clock::now();
+    for (auto&& needle: batch)
+      if (db.search(needle)) ++found;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto n = static_cast<double>(batch.size());
+    std::cout << fmt::format("{:34s} {:4s} {:10d} lookups {:8d} found {:6.2f} probes/lookup "
+                             "{:10.3f}us/lookup {:12.0f} lookups/s\n",
+                             name, cold ? "cold" : "warm", batch.size(), found,
+                             static_cast<double>(db.probes()) / n, elapsed.count() * 1e6 / n,
+                             n / elapsed.count());
+  };
+
+  bool has_index  = std::filesystem::exists(hibp::prefix_index::sidecar_path(dbfilename));
+  bool has_filter = std::filesystem::exists(hibp::fuse_filter::sidecar_path(dbfilename));
+  bool has_spline = std::filesystem::exists(hibp::spline_index::sidecar_path(dbfilename));
+
+  std::vector<std::pair<std::string, hibp::db_options>> configs;
+  for (auto acc: {hibp::access::stream, hibp::access::pread, hibp::access::mmap}) {
+    if (layout == hibp::layout::eytzinger) { // has its own search, strategy doesn't apply
+      configs.emplace_back(fmt::format("{} eytzinger", access_name(acc)),
+                           hibp::db_options{.acc = acc, .use_filter = false});
+      if (has_filter)
+        configs.emplace_back(fmt::format("{} eytzinger +filter", access_name(acc)),
+                             hibp::db_options{.acc = acc});
+      continue;
     }
-    if (first < dbsize_) {
-      password found(db_, first);
-      if (found == needle) return found;
+    for (auto strat: {hibp::strategy::bisect, hibp::strategy::interpolate}) {
+      for (bool use_index: {false, true}) {
+        if (use_index && !has_index) continue;
+        configs.emplace_back(fmt::format("{} {}{}", access_name(acc),
+                                         strat == hibp::strategy::bisect ? "bisect" : "interpolate",
+                                         use_index ? " +index" : ""),
+                             hibp::db_options{.acc        = acc,
+                                              .strat      = strat,
+                                              .use_index  = use_index,
+                                              .use_filter = false});
+      }
     }
-    return std::nullopt;
+    if (has_spline)
+      configs.emplace_back(fmt::format("{} learned", access_name(acc)),
+                           hibp::db_options{.acc        = acc,
+                                            .strat      = hibp::strategy::learned,
+                                            .use_filter = false});
+    if (has_filter) // on top of the fastest search
+      configs.emplace_back(fmt::format("{} interpolate{} +filter", access_name(acc),
+                                       has_index ? " +index" : ""),
+                           hibp::db_options{.acc = acc, .strat = hibp::strategy::interpolate});
   }
 
-  std::optional<password> search(const std::string& sha1_pw_hash_txt) {
-    hibp::password needle(sha1_pw_hash_txt);
-    return search(needle);
-  }
+  for (auto&& [name, opts]: configs) run(name, opts, true);
+
+  warm_page_cache(dbfilename);
+  for (auto&& [name, opts]: configs) run(name, opts, false);
+  if (layout == hibp::layout::sorted)
+    run("mmap bisect preload",
+        {.acc = hibp::access::mmap, .preload = true, .use_index = false, .use_filter = false},
+        false);
+  // batches of sparse lookups, where io_uring can keep many reads in flight
+  std::vector<hibp::access> batch_accs{hibp::access::stream, hibp::access::pread,
+                                       hibp::access::mmap};
+  if (hibp::uring::supported()) batch_accs.push_back(hibp::access::uring);
+  auto run_batch = [&](hibp::access acc, bool cold) {
+    std::span<const hibp::password> batch = needles;
+    if (cold) {
+      hibp::evict_page_cache(dbfilename);
+      batch = batch.first(std::min(batch.size(), cold_lookups));
+    }
+    hibp::database db(dbfilename, {.acc = acc});
+    auto           start   = std::chrono::steady_clock::now();
+    auto           results = db.search_batch(batch);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto n = static_cast<double>(batch.size());
+    std::cout << fmt::format("{:34s} {:4s} {:10d} lookups {:8d} found {:6.2f} probes/lookup "
+                             "{:10.3f}us/lookup {:12.0f} lookups/s\n",
+                             fmt::format("{} batch", access_name(acc)), cold ? "cold" : "warm",
+                             batch.size(),
+                             std::count_if(results.begin(), results.end(),
+                                           [](auto& r) { return r.has_value(); }),
+                             static_cast<double>(db.probes()) / n, elapsed.count() * 1e6 / n,
+                             n / elapsed.count());
+  };
+  for (auto acc: batch_accs) run_batch(acc, true);
+  warm_page_cache(dbfilename);
+  for (auto acc: batch_accs) run_batch(acc, false);
 
-  std::ifstream& db() { return db_; }
+  // scaling: one shared database with default options, the needles split evenly between threads
+  unsigned                 cores = std::max(1U, std::thread::hardware_concurrency());
+  std::vector<unsigned>    thread_counts;
+  for (unsigned t = 1; t < cores; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(cores);
+  for (auto acc: {hibp::access::stream, hibp::access::pread, hibp::access::mmap}) {
+    for (auto threads: thread_counts) {
+      hibp::database           db(dbfilename, {.acc = acc, .strat = hibp::strategy::interpolate});
+      std::atomic<std::size_t> found = 0;
+      std::vector<std::thread> workers;
+      auto                     start = std::chrono::steady_clock::now();
+      for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+          std::size_t first = needles.size() * t / threads;
+          std::size_t last  = needles.size() * (t + 1) / threads;
+          std::size_t f     = 0;
+          for (std::size_t i = first; i < last; ++i)
+            if (db.search(needles[i])) ++f;
+          found += f;
+        });
+      }
+      for (auto& w: workers) w.join();
+      std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-private:
-  std::string           dbfilename_;
-  std::filesystem::path dbpath_;
-  std::size_t           dbfsize_;
-  std::size_t           dbsize_;
-  std::ifstream         db_;
-};
+      auto n = static_cast<double>(needles.size());
+      std::cout << fmt::format("{:34s} warm {:10d} lookups {:8d} found {:6.2f} probes/lookup "
+                               "{:10.3f}us/lookup {:12.0f} lookups/s\n",
+                               fmt::format("{} {} threads", access_name(acc), threads),
+                               needles.size(), found.load(),
+                               static_cast<double>(db.probes()) / n, elapsed.count() * 1e6 / n,
+                               n / elapsed.count());
+    }
+  }
+}
 
-} // namespace hibp
+} // namespace
 
 int main(int argc, char* argv[]) {
   std::ios_base::sync_with_stdio(false);
 
-  // build db
-  hibp::build(std::cin, std::cout);
-  return 0;
-
   try {
-    if (argc < 3)
-      throw std::domain_error("USAGE: " + std::string(argv[0]) + " dbfile.bin plaintext_password");
+    std::vector<std::string> args(argv, argv + argc);
+    if (args.size() < 2) usage(args[0]);
+
+    const std::string& cmd = args[1];
+    // dbfile.bin is one file or a set of shards, never both (is_sharded throws). Only search,
+    // batch and verify take the shards, the others would not find dbfile.bin
+    if (args.size() > 2 && hibp::is_sharded(args[2]) && cmd != "search" && cmd != "batch" &&
+        cmd != "verify" && cmd != "build-sharded")
+      throw std::domain_error("`" + args[2] + "` is sharded, which `" + cmd +
+                              "` does not support: give it a single shard");
+
+    if (cmd == "build") {
+      if (args.size() < 3) {
+        hibp::build(std::cin, std::cout);
+      } else {
+        build_file<20>(args);
+      }
 
-    hibp::database db(argv[1]);
+    } else if (cmd == "build-ntlm") {
+      // the NTLM corpus, sorted by hash. batch then recognises the db from its header
+      if (args.size() < 3) usage(args[0]);
+      build_file<16>(args);
 
-    SHA1 sha1;
-    sha1.update(argv[2]);
-    hibp::password needle(sha1.final());
+    } else if (cmd == "build-sharded") {
+      if (args.size() < 4) usage(args[0]);
+      hibp::build_sharded(std::cin, args[2], static_cast<unsigned>(std::stoul(args[3])));
 
-    std::cout << "needle = " << needle << "\n";
-    auto found = db.search(needle);
+    } else if (cmd == "shard") {
+      if (args.size() < 4) usage(args[0]);
+      hibp::split_shards(args[2], static_cast<unsigned>(std::stoul(args[3])));
 
-    if (found)
-      std::cout << "found  = " << *found << "\n";
-    else
-      std::cout << "not found\n";
+    } else if (cmd == "sort") {
+      if (args.size() < 3) usage(args[0]);
+      std::ofstream os(args[2], std::ios::binary);
+      if (!os.is_open()) throw std::domain_error("cannot open `" + args[2] + "` for writing");
 
+      hibp::sort_options sopts;
+      if (args.size() > 3) sopts.memory_budget = std::stoull(args[3]) << 20U;
+      hibp::prefix_index index;
+      hibp::build_unsorted(std::cin, os, sopts, &index);
+      index.save(hibp::prefix_index::sidecar_path(args[2]));
+
+    } else if (cmd == "update") {
+      if (args.size() < 3) usage(args[0]);
+      auto stats = hibp::update(args[2], std::cin);
+      std::cerr << fmt::format("added {}, changed {}, {} records\n", stats.added, stats.changed,
+                               stats.records);
+
+    } else if (cmd == "export") {
+      if (args.size() < 3) usage(args[0]);
+      hibp::export_text(args[2], std::cout);
+
+    } else if (cmd == "verify") {
+      if (args.size() < 3) usage(args[0]);
+      auto records =
+          hibp::is_sharded(args[2]) ? hibp::verify_sharded(args[2]) : hibp::verify(args[2]);
+      std::cerr << fmt::format("{} records ok\n", records);
+
+    } else if (cmd == "index") {
+      if (args.size() < 3) usage(args[0]);
+      hibp::build_index(args[2], index_bits(args, 3));
+
+    } else if (cmd == "filter") {
+      if (args.size() < 3) usage(args[0]);
+      hibp::build_filter(args[2]);
+
+    } else if (cmd == "spline") {
+      if (args.size() < 3) usage(args[0]);
+      unsigned error = args.size() > 3 ? static_cast<unsigned>(std::stoul(args[3]))
+                                       : hibp::spline_index::default_error;
+      hibp::build_spline_index(args[2], error);
+
+    } else if (cmd == "counts") {
+      if (args.size() < 3) usage(args[0]);
+      hibp::build_count_index(args[2]);
+
+    } else if (cmd == "eytzinger") {
+      if (args.size() < 4) usage(args[0]);
+      hibp::build_eytzinger(args[2], args[3]);
+
+    } else if (cmd == "compact") {
+      if (args.size() < 4) usage(args[0]);
+      hibp::compact_options copts;
+      if (args.size() > 4) copts.prefix_bytes = static_cast<unsigned>(std::stoul(args[4]));
+      hibp::build_compact(args[2], args[3], copts);
+
+    } else if (cmd == "csearch") {
+      if (args.size() < 4) usage(args[0]);
+      hibp::compact_database cdb(args[2]);
+
+      SHA1 sha1;
+      sha1.update(args[3]);
+      hibp::password needle(sha1.final());
+
+      std::cout << "needle = " << needle << "\n";
+      std::optional<hibp::password> found;
+      if (args.size() > 4) {
+        hibp::database full(args[4], {.acc = hibp::access::mmap});
+        found = cdb.search_verified(needle, full);
+      } else {
+        found = cdb.search(needle);
+      }
+
+      if (found)
+        std::cout << "found  = " << *found << "\n";
+      else
+        std::cout << "not found\n";
+
+    } else if (cmd == "search") {
+      if (args.size() < 4) usage(args[0]);
+
+      hibp::db_options opts;
+      opts.acc = access_flag(args, 4);
+
+      SHA1 sha1;
+      sha1.update(args[3]);
+      hibp::password needle(sha1.final());
+
+      std::cout << "needle = " << needle << "\n";
+      auto found = hibp::is_sharded(args[2]) ? hibp::sharded_database(args[2], opts).search(needle)
+                                             : hibp::database(args[2], opts).search(needle);
+
+      if (found)
+        std::cout << "found  = " << *found << "\n";
+      else
+        std::cout << "not found\n";
+
+    } else if (cmd == "batch") {
+      if (args.size() < 3) usage(args[0]);
+
+      hibp::db_options opts;
+      opts.acc     = access_flag(args, 3);
+      bool sharded = hibp::is_sharded(args[2]);
+      if (db_type(args[2]) == hibp::hash_type::ntlm)
+        sharded ? batch<16, hibp::ntlm_sharded_database>(args[2], opts) : batch<16>(args[2], opts);
+      else
+        sharded ? batch<20, hibp::sharded_database>(args[2], opts) : batch<20>(args[2], opts);
+
+    } else if (cmd == "top" || cmd == "above") {
+      if (args.size() < 4) usage(args[0]);
+
+      hibp::db_options opts;
+      opts.acc = access_flag(args, 4);
+      bool top = cmd == "top";
+      auto arg = std::stoll(args[3]);
+      if (arg < 0 || arg > std::numeric_limits<std::int32_t>::max()) usage(args[0]); // a count
+      if (auto hdr = hibp::read_header(args[2]); hdr && hdr->type == hibp::hash_type::ntlm)
+        ranked<16>(args[2], top, arg, opts);
+      else
+        ranked<20>(args[2], top, arg, opts);
+
+    } else if (cmd == "audit") {
+      // one plaintext password per line. Prints line_number:HASH:count for those found, so the
+      // plaintexts are not echoed.
+      if (args.size() < 3) usage(args[0]);
+
+      hibp::db_options opts;
+      opts.acc = access_flag(args, 3);
+      hibp::database db(args[2], opts);
+
+      constexpr std::size_t       chunk = 1U << 16U;
+      std::vector<std::string>    lines;
+      std::vector<hibp::password> needles;
+      std::size_t                 lineno = 0;
+      std::size_t                 found  = 0;
+
+      auto flush = [&] {
+        std::vector<std::string_view> msgs(lines.begin(), lines.end());
+        needles.resize(msgs.size());
+        hibp::sha1_batch(msgs, needles);
+        auto results = db.search_batch(needles);
+        for (std::size_t i = 0; i < results.size(); ++i) {
+          if (results[i]) {
+            ++found;
+            std::cout << lineno + i + 1 << ":" << *results[i] << "\n";
+          }
+        }
+        lineno += lines.size();
+        lines.clear();
+      };
+
+      for (std::string line; std::getline(std::cin, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back(); // exported on windows
+        lines.push_back(std::move(line));
+        if (lines.size() == chunk) flush();
+      }
+      flush();
+      std::cerr << fmt::format("{} of {} passwords found (sha1: {})\n", found, lineno,
+                               hibp::sha1_name(hibp::sha1_best()));
+
+    } else if (cmd == "serve") {
+      if (args.size() < 3) usage(args[0]);
+      hibp::server_options sopts;
+      if (args.size() > 3) sopts.port = static_cast<std::uint16_t>(std::stoul(args[3]));
+      if (args.size() > 4) sopts.threads = static_cast<unsigned>(std::stoul(args[4]));
+
+      hibp::range_server server(args[2], sopts);
+      static const hibp::range_server* running = nullptr; // for the signal handler
+      running                                  = &server;
+      for (int sig: {SIGINT, SIGTERM}) std::signal(sig, [](int) { running->stop(); });
+
+      std::cerr << fmt::format("serving {} on http://{}:{}/range/{{5 hex digits}}[.bin]\n",
+                               args[2], sopts.address, server.port());
+      server.run();
+
+    } else if (cmd == "bench") {
+      if (args.size() < 3) usage(args[0]);
+      bench(args[2], args.size() > 3 ? std::stoull(args[3]) : 1'000'000);
+
+    } else {
+      usage(args[0]);
+    }
   } catch (const std::exception& e) {
     std::cerr << "something went wrong: " << e.what() << "\n";
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
@@ -0,0 +1,273 @@
+#include "hibp/fuse_filter.hpp"
+#include "hibp/hibp.hpp"
+#include "hibp/mmap.hpp"
+#include "hibp/prefix_index.hpp"
+#include "hibp/spline_index.hpp"
+#include "hibp/uring.hpp"
+#include <algorithm>
+#include <array>
+#include <benchmark/benchmark.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Search latency and throughput of every hibp::database backend against a synthetic database.
+//
+//   HIBP_BENCH_RECORDS  size of the database, default 4M records (~100MB)
+//   HIBP_BENCH_DIR      where to create it, default the temp directory. Cold cache results need
+//                       a real disk here: tmpfs ignores posix_fadvise(DONTNEED)
+//
+// Filter runs with eg --benchmark_filter='BM_search/access:2'. Access is 0 = stream (ifstream),
+// 1 = pread, 2 = mmap, 3 = uring. Strategy is 0 = bisect, 1 = interpolate (both with the .idx),
+// 2 = learned (the .spl).
+
+namespace {
+
+constexpr std::array accesses = {hibp::access::stream, hibp::access::pread, hibp::access::mmap,
+                                 hibp::access::uring};
+constexpr std::array access_names = {"stream", "pread", "mmap", "uring"};
+constexpr std::array strategies   = {hibp::strategy::bisect, hibp::strategy::interpolate,
+                                     hibp::strategy::learned};
+
+std::size_t env_size(const char* name, std::size_t fallback) {
+  const char* value = std::getenv(name); // NOLINT not thread safe, but we don't setenv
+  return value != nullptr ? std::stoull(value) : fallback;
+}
+
+std::filesystem::path bench_dir() {
+  const char* dir = std::getenv("HIBP_BENCH_DIR"); // NOLINT not thread safe, but we don't setenv
+  return dir != nullptr ? std::filesystem::path(dir) : std::filesystem::temp_directory_path();
+}
+
+// Uniformly random sha1s in sorted .bin, with .idx, .spl and .fuse sidecars, built on first use and
+// removed at exit. Like the real corpus, as far as the search algorithms can tell.
+class synthetic_db {
+public:
+  static const synthetic_db& get() {
+    static const synthetic_db db;
+    return db;
+  }
+
+  synthetic_db(const synthetic_db& m) = delete;
+  synthetic_db& operator=(const synthetic_db& other) = delete;
+
+  synthetic_db(synthetic_db&& other) noexcept = delete;
+  synthetic_db& operator=(synthetic_db&& other) noexcept = delete;
+
+  [[nodiscard]] const std::filesystem::path& path() const { return path_; }
+
+  // a shuffled cycle of needles, hit_pct percent of which are in the db
+  [[nodiscard]] std::span<const hibp::password> needles(std::int64_t hit_pct) const {
+    return needles_.at(static_cast<std::size_t>(hit_pct / 50));
+  }
+
+  // read the whole file once, so every page is in cache
+  void warm() const {
+    std::ifstream     is(path_, std::ios::binary);
+    std::vector<char> buf(1U << 20U);
+    while (is.read(buf.data(), static_cast<std::streamsize>(buf.size()))) {
+    }
+  }
+
+private:
+  synthetic_db() : path_(bench_dir() / ("hibp_bench_" + std::to_string(::getpid()) + ".bin")) {
+    std::size_t                                  n = env_size("HIBP_BENCH_RECORDS", 4U << 20U);
+    std::mt19937_64                              rgen(1); // NOLINT fixed seed
+    std::uniform_int_distribution<std::uint32_t> countdist(1, 1000);
+
+    auto random_pw = [&] {
+      hibp::password pw{};
+      for (std::size_t i = 0; i < pw.hash.size(); i += sizeof(std::uint64_t)) {
+        std::uint64_t r = rgen();
+        std::memcpy(pw.hash.data() + i, &r, std::min(sizeof(r), pw.hash.size() - i));
+      }
+      pw.count = static_cast<std::int32_t>(countdist(rgen));
+      return pw;
+    };
+
+    std::vector<hibp::password> records(n);
+    std::generate(records.begin(), records.end(), random_pw);
+    std::sort(records.begin(), records.end());
+    records.erase(std::unique(records.begin(), records.end()), records.end());
+
+    {
+      std::ofstream os(path_, std::ios::binary);
+      os.write(reinterpret_cast<const char*>(records.data()), // NOLINT reincast
+               static_cast<std::streamsize>(records.size() * sizeof(hibp::password)));
+      if (!os) throw std::domain_error("failed writing " + path_.string());
+    }
+    hibp::prefix_index index;
+    hibp::spline_index spline;
+    for (auto&& pw: records) {
+      index.add(pw);
+      spline.add(pw);
+    }
+    index.save(hibp::prefix_index::sidecar_path(path_));
+    spline.save(hibp::spline_index::sidecar_path(path_));
+    hibp::build_filter(path_);
+
+    constexpr std::size_t                      cycle = 1U << 16U;
+    std::uniform_int_distribution<std::size_t> posdist(0, records.size() - 1);
+    for (std::size_t h = 0; h < needles_.size(); ++h) {
+      auto& needles = needles_[h];
+      needles.resize(cycle);
+      for (std::size_t i = 0; i < cycle; ++i) {
+        if (i < cycle * h / 2) {
+          needles[i] = records[posdist(rgen)];
+        } else {
+          do {
+            needles[i] = random_pw();
+          } while (std::binary_search(records.begin(), records.end(), needles[i]));
+        }
+      }
+      std::shuffle(needles.begin(), needles.end(), rgen);
+    }
+  }
+
+  ~synthetic_db() {
+    std::filesystem::remove(path_);
+    std::filesystem::remove(hibp::prefix_index::sidecar_path(path_));
+    std::filesystem::remove(hibp::spline_index::sidecar_path(path_));
+    std::filesystem::remove(hibp::fuse_filter::sidecar_path(path_));
+  }
+
+  std::filesystem::path                      path_;
+  std::array<std::vector<hibp::password>, 3> needles_; // 0%, 50% and 100% hits
+};
+
+// args: access, strategy, hit%, filter
+hibp::db_options options(const benchmark::State& state) {
+  return {.acc        = accesses.at(static_cast<std::size_t>(state.range(0))),
+          .strat      = strategies.at(static_cast<std::size_t>(state.range(1))),
+          .use_filter = state.range(3) != 0};
+}
+
+bool skip_unsupported(benchmark::State& state, const hibp::db_options& opts) {
+  state.SetLabel(access_names.at(static_cast<std::size_t>(state.range(0))));
+  if (opts.acc == hibp::access::uring && !hibp::uring::supported()) {
+    state.SkipWithError("io_uring is not available");
+    return true;
+  }
+  return false;
+}
+
+std::unique_ptr<hibp::database> shared_db; // NOLINT global: one database for all threads of a run
+
+// warm cache latency, and throughput with several threads sharing one database
+void BM_search(benchmark::State& state) {
+  const auto& sdb  = synthetic_db::get();
+  auto        opts = options(state);
+  if (skip_unsupported(state, opts)) return;
+  if (state.thread_index() == 0) {
+    sdb.warm();
+    shared_db = std::make_unique<hibp::database>(sdb.path().string(), opts);
+  }
+  auto needles = sdb.needles(state.range(2));
+
+  // the loop starts once thread 0 has set up shared_db
+  std::size_t i = static_cast<std::size_t>(state.thread_index()) * needles.size() /
+                  static_cast<std::size_t>(state.threads());
+  for (auto _: state) benchmark::DoNotOptimize(shared_db->search(needles[i++ % needles.size()]));
+
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    // counters are summed over threads, and averaged over the iterations of all of them
+    state.counters["probes"] = benchmark::Counter(static_cast<double>(shared_db->probes()),
+                                                  benchmark::Counter::kAvgIterations);
+    shared_db.reset();
+  }
+}
+
+// Cold cache latency: each iteration evicts the file from the page cache, opens a new database
+// (unmapping any mmap) and then times a run of lookups.
+void BM_search_cold(benchmark::State& state) {
+  constexpr std::size_t lookups = 256;
+
+  const auto& sdb  = synthetic_db::get();
+  auto        opts = options(state);
+  if (skip_unsupported(state, opts)) return;
+  auto needles = sdb.needles(state.range(2));
+
+  std::optional<hibp::database> db;
+  std::size_t                   i      = 0;
+  std::size_t                   probes = 0;
+  for (auto _: state) {
+    state.PauseTiming();
+    if (db) probes += db->probes();
+    db.reset();
+    hibp::evict_page_cache(sdb.path());
+    db.emplace(sdb.path().string(), opts);
+    state.ResumeTiming();
+    for (std::size_t l = 0; l < lookups; ++l)
+      benchmark::DoNotOptimize(db->search(needles[i++ % needles.size()]));
+  }
+  if (db) probes += db->probes();
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(lookups));
+  state.counters["probes"] = benchmark::Counter(static_cast<double>(probes) /
+                                                    static_cast<double>(lookups),
+                                                benchmark::Counter::kAvgIterations);
+}
+
+// Throughput of search_batch on sparse batches, where io_uring keeps many reads in flight.
+// args: access, hit%, cold
+void BM_search_batch(benchmark::State& state) {
+  constexpr std::size_t batch = 1024;
+
+  const auto&      sdb  = synthetic_db::get();
+  hibp::db_options opts = {.acc = accesses.at(static_cast<std::size_t>(state.range(0)))};
+  bool             cold = state.range(2) != 0;
+  if (skip_unsupported(state, opts)) return;
+  auto needles = sdb.needles(state.range(1));
+
+  if (!cold) sdb.warm();
+  std::optional<hibp::database> db;
+  if (!cold) db.emplace(sdb.path().string(), opts);
+
+  std::size_t offset = 0;
+  for (auto _: state) {
+    if (cold) {
+      state.PauseTiming();
+      db.reset();
+      hibp::evict_page_cache(sdb.path());
+      db.emplace(sdb.path().string(), opts);
+      state.ResumeTiming();
+    }
+    benchmark::DoNotOptimize(db->search_batch(needles.subspan(offset, batch)));
+    offset = (offset + batch) % (needles.size() - batch);
+  }
+  state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(batch));
+}
+
+const int max_threads = static_cast<int>(std::max(1U, std::thread::hardware_concurrency()));
+
+} // namespace
+
+BENCHMARK(BM_search)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}, {0, 50, 100}, {0, 1}})
+    ->ArgNames({"access", "strategy", "hit%", "filter"})
+    ->ThreadRange(1, max_threads)
+    ->UseRealTime();
+
+BENCHMARK(BM_search_cold)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 1, 2}, {0, 50, 100}, {0, 1}})
+    ->ArgNames({"access", "strategy", "hit%", "filter"})
+    ->UseRealTime(); // waiting for the disk is not cpu time
+
+BENCHMARK(BM_search_batch)
+    ->ArgsProduct({{0, 1, 2, 3}, {0, 50, 100}, {0, 1}})
+    ->ArgNames({"access", "hit%", "cold"})
+    ->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -9,6 +9,7 @@
 #include <iostream>
 #include <numeric>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 #include <vector>
 
@@ -59,39 +60,40 @@ struct member {
   }
 };
 
-std::vector<member> load_members(int limit = 10'000) {
-  std::vector<member> members;
+template <>
+struct mypp::row_map<member> {
+  static constexpr auto fields = std::tuple{
+      // clang-format off
+      mypp::field{"firstname",              &member::firstname},
+      mypp::field{"lastname",               &member::lastname},
+      mypp::field{"email",                  &member::email},
+      mypp::field{"dob",                    &member::dob},
+      mypp::field{"date_of_last_logon",     &member::date_of_last_logon},
+      mypp::field{"created_at",             &member::created_at},
+      mypp::field{"updated_at",             &member::updated_at},
+      mypp::field{"email_failure_count",    &member::email_failure_count},
+      mypp::field{"invalid",                &member::invalid},
+      mypp::field{"invalidated_time",       &member::invalidated_time},
+      // clang-format on
+  };
+};
 
-  for (auto&& r: db().query("select "
-                            "  firstname, "
-                            "  lastname, "
-                            "  email, "
-                            "  dob, "
-                            "  date_of_last_logon, "
-                            "  created_at, "
-                            "  updated_at, "
-                            "  email_failure_count, "
-                            "  invalid, "
-                            "  invalidated_time "
-                            "from member limit " +
-                            std::to_string(limit))) {
-
-    members.push_back({
-        // clang-format off
-        .firstname              = r.get(0),
-        .lastname               = r.get(1),
-        .email                  = r.get(2),
-        .dob                    = r.get<std::optional<date::sys_days>>(3),
-        .date_of_last_logon     = r.get<std::optional<date::sys_seconds>>(4),
-        .created_at             = r.get<std::optional<date::sys_seconds>>(5),
-        .updated_at             = r.get<std::optional<date::sys_seconds>>(6),
-        .email_failure_count    = r.get<int>(7),
-        .invalid                = r.get<bool>(8),
-        .invalidated_time       = r.get<std::optional<date::sys_seconds>>(9)
-        // clang-format on
-    });
-  }
-  return members;
+std::vector<member> load_members(int limit = 10'000) {
+  return db()
+      .query("select "
+             "  firstname, "
+             "  lastname, "
+             "  email, "
+             "  dob, "
+             "  date_of_last_logon, "
+             "  created_at, "
+             "  updated_at, "
+             "  email_failure_count, "
+             "  invalid, "
+             "  invalidated_time "
+             "from member limit " +
+             std::to_string(limit))
+      .as<member>(static_cast<std::size_t>(limit));
 }
 
 struct tax_rate {
@@ -158,23 +160,25 @@ struct order_lineitem {
 std::vector<order_lineitem> load_order_lineitems() {
   std::vector<order_lineitem> order_lineitems;
 
-  for (auto&& r: db().query("select "
-                            "  id, "
-                            "  order_id, "
-                            "  description, "
-                            "  tax_rate, "
-                            "  value_without_tax, "
-                            "  value_with_tax "
-                            "from order_lineitem")) {
-
+  // binary protocol: the ints and doubles arrive as such, no parsing
+  mypp::statement st(db(), "select "
+                           "  id, "
+                           "  order_id, "
+                           "  description, "
+                           "  tax_rate, "
+                           "  value_without_tax, "
+                           "  value_with_tax "
+                           "from order_lineitem");
+  st.execute();
+  while (st.fetch()) {
     order_lineitems.push_back({
         // clang-format off
-        .id                     = r.get<int>(0),
-        .order_id               = r.get<int>(1),
-        .description            = r.get(2),
-        .tax_rate               = r.get<double>(3),
-        .value_without_tax      = r.get<double>(4),
-        .value_with_tax         = r.get<double>(5)
+        .id                     = st.get<int>(0),
+        .order_id               = st.get<int>(1),
+        .description            = st.get(2),
+        .tax_rate               = st.get<double>(3),
+        .value_without_tax      = st.get<double>(4),
+        .value_with_tax         = st.get<double>(5)
         // clang-format on
     });
   }
@@ -0,0 +1,189 @@
+#include "compact.hpp"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <vector>
+
+namespace hibp {
+
+namespace {
+
+constexpr std::size_t flush_size = 1U << 20U;
+
+void put_varint(std::vector<char>& buf, std::uint32_t v) {
+  while (v >= 0x80U) {
+    buf.push_back(static_cast<char>((v & 0x7FU) | 0x80U));
+    v >>= 7U;
+  }
+  buf.push_back(static_cast<char>(v));
+}
+
+void flush(std::ofstream& os, std::vector<char>& buf) {
+  os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+  buf.clear();
+}
+
+std::uint64_t offset(std::ofstream& os) {
+  return static_cast<std::uint64_t>(static_cast<std::streamoff>(os.tellp()));
+}
+
+} // namespace
+
+void build_compact(const std::filesystem::path& dbpath, const std::filesystem::path& compact_path,
+                   compact_options opts) {
+  if (opts.prefix_bytes == 0 || opts.prefix_bytes > sizeof(password::hash))
+    throw std::domain_error("prefix_bytes must be in 1.." +
+                            std::to_string(sizeof(password::hash)));
+  if (opts.block_size == 0) throw std::domain_error("block_size must be > 0");
+
+  database db(dbpath.string(), {.use_index = false});
+  if (db.get_layout() != layout::sorted)
+    throw std::domain_error("compact format requires a sorted db: " + dbpath.string());
+
+  std::ofstream os(compact_path, std::ios::binary);
+  if (!os.is_open())
+    throw std::domain_error("cannot open `" + compact_path.string() + "` for writing");
+
+  compact_header hdr{.prefix_bytes  = opts.prefix_bytes,
+                     .records       = db.size(),
+                     .block_size    = opts.block_size,
+                     .counts_offset = 0,
+                     .blocks_offset = 0};
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast placeholder
+
+  std::vector<char> buf;
+  buf.reserve(flush_size + sizeof(password));
+
+  // pass 1: the truncated hashes
+  db.for_each([&](const password& pw) {
+    const auto* p = reinterpret_cast<const char*>(pw.hash.data()); // NOLINT reincast
+    buf.insert(buf.end(), p, p + opts.prefix_bytes);
+    if (buf.size() >= flush_size) flush(os, buf);
+    return true;
+  });
+  flush(os, buf);
+
+  // pass 2: the counts, recording where each block starts
+  hdr.counts_offset = offset(os);
+  std::vector<std::uint64_t> blocks;
+  blocks.reserve(db.size() / opts.block_size + 2);
+  std::uint64_t blobsize = 0;
+  std::size_t   pos      = 0;
+  db.for_each([&](const password& pw) {
+    if (pos++ % opts.block_size == 0) blocks.push_back(blobsize + buf.size());
+    put_varint(buf, static_cast<std::uint32_t>(pw.count) + 1U); // count is >= -1, may be max
+    if (buf.size() >= flush_size) {
+      blobsize += buf.size();
+      flush(os, buf);
+    }
+    return true;
+  });
+  blobsize += buf.size();
+  blocks.push_back(blobsize);
+  buf.resize(buf.size() + (8 - (hdr.counts_offset + blobsize) % 8) % 8); // align block offsets
+  flush(os, buf);
+
+  hdr.blocks_offset = offset(os);
+  os.write(reinterpret_cast<const char*>(blocks.data()), // NOLINT reincast
+           static_cast<std::streamsize>(blocks.size() * sizeof(blocks[0])));
+
+  os.seekp(0);
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  if (!os) throw std::domain_error("failed writing `" + compact_path.string() + "`");
+}
+
+// hibp::compact_database
+
+compact_database::compact_database(const std::filesystem::path& path, bool preload)
+    : map_(path) {
+
+  if (map_.size() < sizeof(hdr_)) throw std::domain_error("not a compact db: " + path.string());
+  std::memcpy(&hdr_, map_.data(), sizeof(hdr_));
+
+  if (hdr_.magic != compact_header::magic_bytes)
+    throw std::domain_error("not a compact db: " + path.string());
+  if (hdr_.version > compact_header::current_version)
+    throw std::domain_error("compact db version " + std::to_string(hdr_.version) +
+                            " is newer than this program supports: " + path.string());
+
+  std::uint64_t blocks = (hdr_.records + hdr_.block_size - 1) / std::max(hdr_.block_size, 1U);
+  if (hdr_.prefix_bytes == 0 || hdr_.prefix_bytes > sizeof(password::hash) ||
+      hdr_.block_size == 0 || hdr_.records > map_.size() ||
+      hdr_.counts_offset != sizeof(hdr_) + hdr_.records * hdr_.prefix_bytes ||
+      hdr_.blocks_offset % sizeof(std::uint64_t) != 0 ||
+      hdr_.blocks_offset + (blocks + 1) * sizeof(std::uint64_t) != map_.size())
+    throw std::domain_error("corrupt or truncated compact db: " + path.string());
+
+  prefixes_ = map_.data() + sizeof(hdr_);
+  // NOLINTNEXTLINE reincast
+  counts_ = reinterpret_cast<const std::uint8_t*>(map_.data() + hdr_.counts_offset);
+  // NOLINTNEXTLINE reincast, blocks_offset is 8 byte aligned
+  blocks_ = reinterpret_cast<const std::uint64_t*>(map_.data() + hdr_.blocks_offset);
+
+  // every block must start and end within the counts, so count_at() cannot stray outside them
+  std::uint64_t counts_size = hdr_.blocks_offset - hdr_.counts_offset;
+  if (blocks_[0] != 0 || blocks_[blocks] > counts_size)
+    throw std::domain_error("corrupt compact db block offsets: " + path.string());
+  for (std::uint64_t i = 0; i < blocks; ++i)
+    if (blocks_[i] > blocks_[i + 1])
+      throw std::domain_error("corrupt compact db block offsets: " + path.string());
+
+  map_.advise(MADV_RANDOM);
+  if (preload) map_.lock();
+}
+
+std::int32_t compact_database::count_at(std::size_t pos) const {
+  std::size_t         block   = pos / hdr_.block_size;
+  const std::uint8_t* p       = counts_ + blocks_[block];
+  const std::uint8_t* end     = counts_ + blocks_[block + 1];
+  auto                corrupt = [] { throw std::domain_error("corrupt compact db counts"); };
+
+  for (std::size_t skip = pos % hdr_.block_size; skip > 0; --skip) {
+    do {
+      if (p == end) corrupt();
+    } while ((*p++ & 0x80U) != 0);
+  }
+
+  std::uint32_t v     = 0;
+  unsigned      shift = 0;
+  std::uint8_t  b     = 0;
+  do {
+    if (p == end || shift > 28) corrupt(); // a uint32 takes at most 5 bytes, the last at << 28
+    b = *p++;
+    v |= static_cast<std::uint32_t>(b & 0x7FU) << shift;
+    shift += 7;
+  } while ((b & 0x80U) != 0);
+  return static_cast<std::int32_t>(v - 1U); // v is count + 1, so v - 1 fits
+}
+
+std::optional<password> compact_database::search(const password& needle) const {
+  const auto* key   = needle.hash.data();
+  std::size_t first = 0;
+  std::size_t count = hdr_.records;
+  // lower_bound binary search algo
+  while (count > 0) {
+    std::size_t step = count / 2;
+    std::size_t pos  = first + step;
+    if (std::memcmp(prefix(pos), key, hdr_.prefix_bytes) < 0) {
+      first = pos + 1;
+      count -= step + 1;
+    } else
+      count = step;
+  }
+  if (first < hdr_.records && std::memcmp(prefix(first), key, hdr_.prefix_bytes) == 0) {
+    password found = needle;
+    found.count    = count_at(first);
+    return found;
+  }
+  return std::nullopt;
+}
+
+std::optional<password> compact_database::search_verified(const password& needle,
+                                                          const database& full) const {
+  if (!search(needle)) return std::nullopt;
+  return full.search(needle);
+}
+
+} // namespace hibp
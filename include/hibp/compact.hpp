@@ -0,0 +1,77 @@
+#pragma once
+
+#include "hibp/hibp.hpp"
+#include "hibp/mmap.hpp"
+#include "hibp/password.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+namespace hibp {
+
+// Compact, versioned alternative to the .bin format:
+//
+//   compact_header
+//   records * prefix_bytes     leading bytes of each sorted hash
+//   count blob                 per block of block_size records: LEB128 varints of count + 1
+//   (blocks + 1) * uint64      offset of each block within the count blob
+//
+// With 8 byte prefixes a record costs ~9-10 bytes instead of 24, and the chance of a random
+// hash falsely matching one of 1e9 records is ~5e-11. Use search_verified() to rule that out.
+struct compact_header {
+  static constexpr std::array<char, 8> magic_bytes = {'H', 'I', 'B', 'P', 'C', 'M', 'P', '\0'};
+  static constexpr std::uint32_t       current_version = 1;
+
+  std::array<char, 8>       magic   = magic_bytes;
+  std::uint32_t             version = current_version;
+  std::uint32_t             prefix_bytes;
+  std::uint64_t             records;
+  std::uint32_t             block_size;
+  std::uint32_t             reserved0 = 0;
+  std::uint64_t             counts_offset; // file offsets of the sections
+  std::uint64_t             blocks_offset;
+  std::array<std::byte, 16> reserved{};
+};
+static_assert(sizeof(compact_header) == 64, "compact_header must stay 64 bytes");
+
+struct compact_options {
+  // 1..20. Records whose prefixes collide are all kept, search() reports the first one's count
+  unsigned prefix_bytes = 8;
+  unsigned block_size   = 64; // records per count block: smaller is faster, larger is smaller
+};
+
+// convert a sorted .bin in two sequential passes
+void build_compact(const std::filesystem::path& dbpath, const std::filesystem::path& compact_path,
+                   compact_options opts = {});
+
+class compact_database {
+public:
+  // preload: read ahead and mlock the whole file
+  explicit compact_database(const std::filesystem::path& path, bool preload = false);
+
+  // Matches on the first prefix_bytes of the hash only. The result carries the needle's hash
+  // and the stored count.
+  [[nodiscard]] std::optional<password> search(const password& needle) const;
+
+  // compact misses are definitive, compact hits are confirmed against the full width .bin
+  std::optional<password> search_verified(const password& needle, const database& full) const;
+
+  [[nodiscard]] std::size_t size() const { return hdr_.records; }
+  [[nodiscard]] unsigned    prefix_bytes() const { return hdr_.prefix_bytes; }
+
+private:
+  [[nodiscard]] const std::byte* prefix(std::size_t pos) const {
+    return prefixes_ + pos * hdr_.prefix_bytes;
+  }
+  [[nodiscard]] std::int32_t count_at(std::size_t pos) const;
+
+  mmap_file            map_;
+  compact_header       hdr_{};
+  const std::byte*     prefixes_ = nullptr;
+  const std::uint8_t*  counts_   = nullptr;
+  const std::uint64_t* blocks_   = nullptr;
+};
+
+} // namespace hibp
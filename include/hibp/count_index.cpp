@@ -0,0 +1,103 @@
+#include "count_index.hpp"
+#include "header.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+
+namespace hibp {
+
+namespace {
+
+struct count_index_header {
+  std::array<char, 8> magic;
+  std::uint64_t       records;
+  std::uint32_t       generation; // of the db it was built from
+  std::uint32_t       reserved;
+};
+
+constexpr std::array<char, 8> count_index_magic = {'H', 'I', 'B', 'P', 'C', 'N', 'T', '2'};
+// 1 had no generation, and is rejected: it may belong to an older version of the db
+constexpr std::array<char, 8> count_index_magic_v1 = {'H', 'I', 'B', 'P', 'C', 'N', 'T', '1'};
+
+template <std::size_t N>
+void add_all(const std::filesystem::path& dbpath, count_index& counts) {
+  basic_database<N> db(dbpath.string(), {.use_index = false, .use_filter = false});
+  db.for_each([&](const basic_password<N>& pw) {
+    counts.add(pw);
+    return true;
+  });
+}
+
+} // namespace
+
+count_index::count_index(const std::filesystem::path& path) : map_(path) {
+  count_index_header hdr{};
+  if (map_.size() >= sizeof(hdr)) std::memcpy(&hdr, map_.data(), sizeof(hdr));
+  if (map_.size() >= sizeof(hdr.magic) &&
+      std::memcmp(map_.data(), count_index_magic_v1.data(), sizeof(hdr.magic)) == 0)
+    throw std::domain_error("outdated count index format: " + path.string() +
+                            ". Rebuild it with `hibp counts`");
+  if (hdr.magic != count_index_magic)
+    throw std::domain_error("not a valid hibp count index file: " + path.string());
+  if (map_.size() != sizeof(hdr) + hdr.records * sizeof(std::uint32_t))
+    throw std::domain_error("truncated hibp count index file: " + path.string());
+
+  records_    = hdr.records;
+  generation_ = hdr.generation;
+  ordinals_   = reinterpret_cast<const std::uint32_t*>( // NOLINT reincast
+      map_.data() + sizeof(hdr));
+  map_.advise(MADV_RANDOM); // top() reads a prefix, at_least() bisects
+}
+
+void count_index::add_count(std::int32_t count) {
+  if (pending_.size() > std::numeric_limits<std::uint32_t>::max())
+    throw std::domain_error("count index: too many records for 32 bit ordinals");
+  pending_.emplace_back(count, static_cast<std::uint32_t>(pending_.size()));
+}
+
+void count_index::save(const std::filesystem::path& path, std::uint32_t generation) {
+  // highest count first, ties (and unknown counts of -1, last) in file order
+  std::sort(pending_.begin(), pending_.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first > b.first : a.second < b.second;
+  });
+
+  std::ofstream os(path, std::ios::binary);
+  if (!os.is_open())
+    throw std::domain_error("cannot open count index for writing: " + path.string());
+
+  count_index_header hdr{.magic      = count_index_magic,
+                         .records    = pending_.size(),
+                         .generation = generation,
+                         .reserved   = 0};
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+
+  constexpr std::size_t      bufcnt = 1U << 16U;
+  std::vector<std::uint32_t> buf;
+  buf.reserve(bufcnt);
+  for (std::size_t i = 0; i < pending_.size(); ++i) {
+    buf.push_back(pending_[i].second);
+    if (buf.size() == bufcnt || i + 1 == pending_.size()) {
+      os.write(reinterpret_cast<const char*>(buf.data()), // NOLINT reincast
+               static_cast<std::streamsize>(buf.size() * sizeof(buf[0])));
+      buf.clear();
+    }
+  }
+  if (!os) throw std::domain_error("failed writing count index: " + path.string());
+}
+
+void build_count_index(const std::filesystem::path& dbpath) {
+  count_index counts;
+  auto        hdr = read_header(dbpath);
+  if (hdr && hdr->type == hash_type::ntlm)
+    add_all<16>(dbpath, counts);
+  else
+    add_all<20>(dbpath, counts);
+  counts.save(count_index::sidecar_path(dbpath), hdr ? hdr->generation : 0);
+}
+
+} // namespace hibp
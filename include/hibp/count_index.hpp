@@ -0,0 +1,115 @@
+#pragma once
+
+#include "hibp/hibp.hpp"
+#include "hibp/mmap.hpp"
+#include "hibp/password.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+// Secondary index of a .bin by descending count: the ordinal (file position) of each record, 4
+// bytes per record. top() and at_least() then read only the records they return, plus ~log2(n)
+// to find a threshold, instead of scanning the whole file. Stored as a sidecar file next to the
+// .bin (see sidecar_path()).
+class count_index {
+public:
+  // an empty index, ready for add()
+  count_index() = default;
+
+  // map a previously save()'d index
+  explicit count_index(const std::filesystem::path& path);
+
+  // One call per record in file order, as for prefix_index. Holds 8 bytes per record in RAM
+  // until save().
+  template <std::size_t N>
+  void add(const basic_password<N>& pw) {
+    add_count(pw.count);
+  }
+  // stamped with the file_header::generation of the .bin it indexes
+  void save(const std::filesystem::path& path, std::uint32_t generation = 0);
+
+  [[nodiscard]] std::size_t   records() const { return records_; }
+  [[nodiscard]] std::uint32_t generation() const { return generation_; }
+
+  // file position of the record with the rank'th highest count (0-based), ties in file order
+  [[nodiscard]] std::uint32_t ordinal(std::size_t rank) const { return ordinals_[rank]; }
+
+  // the (up to) n records with the highest counts, highest first
+  template <std::size_t N>
+  std::vector<basic_password<N>> top(const basic_database<N>& db, std::size_t n) const;
+
+  // all records with count >= min_count, highest first
+  template <std::size_t N>
+  std::vector<basic_password<N>> at_least(const basic_database<N>& db,
+                                          std::int32_t             min_count) const;
+
+  static std::filesystem::path sidecar_path(const std::filesystem::path& dbpath) {
+    return dbpath.string() + ".cnt";
+  }
+
+private:
+  void add_count(std::int32_t count);
+
+  template <std::size_t N>
+  void check(const basic_database<N>& db) const;
+
+  std::vector<std::pair<std::int32_t, std::uint32_t>> pending_; // build only: count, ordinal
+  mmap_file                                           map_;
+  const std::uint32_t*                                ordinals_   = nullptr; // into map_
+  std::size_t                                         records_    = 0;
+  std::uint32_t                                       generation_ = 0; // loaded only
+};
+
+// (re)generate the count index for an existing .bin in one sequential pass
+void build_count_index(const std::filesystem::path& dbpath);
+
+template <std::size_t N>
+void count_index::check(const basic_database<N>& db) const {
+  if (db.size() != records_)
+    throw std::domain_error("stale count index: it has " + std::to_string(records_) +
+                            " records, the db " + std::to_string(db.size()) +
+                            ". Rebuild it with `hibp counts`");
+  if (db.generation() != generation_)
+    throw std::domain_error("stale count index: it is of generation " +
+                            std::to_string(generation_) + ", the db " +
+                            std::to_string(db.generation()) + ". Rebuild it with `hibp counts`");
+}
+
+template <std::size_t N>
+std::vector<basic_password<N>> count_index::top(const basic_database<N>& db,
+                                                std::size_t              n) const {
+  check(db);
+  std::vector<basic_password<N>> pws;
+  pws.reserve(std::min(n, records_));
+  for (std::size_t rank = 0; rank < records_ && rank < n; ++rank)
+    pws.push_back(db.get(ordinals_[rank]));
+  return pws;
+}
+
+template <std::size_t N>
+std::vector<basic_password<N>> count_index::at_least(const basic_database<N>& db,
+                                                     std::int32_t             min_count) const {
+  check(db);
+  // bisect for the first rank below min_count, one record read per step
+  std::size_t first = 0;
+  std::size_t count = records_;
+  while (count > 0) {
+    std::size_t step = count / 2;
+    if (db.get(ordinals_[first + step]).count >= min_count) {
+      first += step + 1;
+      count -= step + 1;
+    } else {
+      count = step;
+    }
+  }
+  return top(db, first);
+}
+
+} // namespace hibp
@@ -0,0 +1,218 @@
+#include "external_sort.hpp"
+#include "hibp.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace hibp {
+
+namespace {
+
+// more open runs than this and we merge in several passes
+constexpr std::size_t max_fanin = 256;
+
+// a count of -1 means "unknown"
+std::int32_t sum_counts(std::int32_t a, std::int32_t b) {
+  if (a < 0) return b;
+  if (b < 0) return a;
+  return static_cast<std::int32_t>(std::min<std::int64_t>(
+      std::int64_t{a} + b, std::numeric_limits<std::int32_t>::max()));
+}
+
+// sorted, deduplicated, on disk. Deleted when the set goes out of scope, even on exceptions.
+struct run_files {
+  run_files() = default;
+
+  run_files(const run_files& m) = delete;
+  run_files& operator=(const run_files& other) = delete;
+
+  run_files(run_files&& other) noexcept = delete;
+  run_files& operator=(run_files&& other) noexcept = delete;
+
+  ~run_files() {
+    std::error_code ec; // ignore, best effort
+    for (auto&& p: paths) std::filesystem::remove(p, ec);
+  }
+
+  std::filesystem::path next_path(const std::filesystem::path& tmpdir) {
+    return tmpdir / ("hibp-run-" + std::to_string(::getpid()) + "-" + std::to_string(serial++));
+  }
+
+  std::vector<std::filesystem::path> paths;
+  std::size_t                        serial = 0;
+};
+
+// buffered sequential reader for one run
+class run_reader {
+public:
+  run_reader(const std::filesystem::path& path, std::size_t bufcnt)
+      : is_(path, std::ios::binary), buf_(bufcnt) {
+    if (!is_.is_open()) throw std::domain_error("cannot open sort run: " + path.string());
+    fill();
+  }
+
+  [[nodiscard]] bool            empty() const { return pos_ == end_; }
+  [[nodiscard]] const password& front() const { return buf_[pos_]; }
+
+  void pop() {
+    if (++pos_ == end_) fill();
+  }
+
+private:
+  void fill() {
+    is_.read(reinterpret_cast<char*>(buf_.data()), // NOLINT reincast
+             static_cast<std::streamsize>(buf_.size() * sizeof(password)));
+    end_ = static_cast<std::size_t>(is_.gcount()) / sizeof(password);
+    pos_ = 0;
+  }
+
+  std::ifstream         is_;
+  std::vector<password> buf_;
+  std::size_t           pos_ = 0;
+  std::size_t           end_ = 0;
+};
+
+// buffered writer which also sums the counts of consecutive equal hashes
+class dedup_writer {
+public:
+  dedup_writer(std::ostream& os, prefix_index* index) : os_(os), index_(index) {
+    buf_.reserve(bufcnt);
+  }
+
+  void push(const password& pw) {
+    if (pending_ && *pending_ == pw) {
+      pending_->count = sum_counts(pending_->count, pw.count);
+      return;
+    }
+    if (pending_) emit(*pending_);
+    pending_ = pw;
+  }
+
+  void finish() {
+    if (pending_) emit(*pending_);
+    pending_.reset();
+    flush();
+  }
+
+private:
+  static constexpr std::size_t bufcnt = 1U << 16U;
+
+  void emit(const password& pw) {
+    if (index_ != nullptr) index_->add(pw);
+    buf_.push_back(pw);
+    if (buf_.size() == bufcnt) flush();
+  }
+
+  void flush() {
+    os_.write(reinterpret_cast<const char*>(buf_.data()), // NOLINT reincast
+              static_cast<std::streamsize>(buf_.size() * sizeof(password)));
+    buf_.clear();
+  }
+
+  std::ostream&           os_;
+  prefix_index*           index_;
+  std::optional<password> pending_;
+  std::vector<password>   buf_;
+};
+
+void write_run(std::vector<password>& pws, const std::filesystem::path& path) {
+  std::sort(pws.begin(), pws.end());
+  std::ofstream os(path, std::ios::binary);
+  if (!os.is_open()) throw std::domain_error("cannot create sort run: " + path.string());
+
+  dedup_writer out(os, nullptr);
+  for (auto&& pw: pws) out.push(pw);
+  out.finish();
+  if (!os) throw std::domain_error("failed writing sort run (disk full?): " + path.string());
+}
+
+void merge_runs(std::span<const std::filesystem::path> runs, std::ostream& os,
+                std::size_t memory_budget, prefix_index* index) {
+  std::size_t bufcnt = std::max<std::size_t>(
+      memory_budget / (runs.size() + 1) / sizeof(password), std::size_t{1} << 12U);
+
+  std::vector<run_reader> readers;
+  readers.reserve(runs.size());
+  for (auto&& path: runs) readers.emplace_back(path, bufcnt);
+
+  auto later = [&](std::size_t a, std::size_t b) {
+    return readers[b].front() < readers[a].front();
+  };
+  std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> heap(later);
+  for (std::size_t i = 0; i < readers.size(); ++i)
+    if (!readers[i].empty()) heap.push(i);
+
+  dedup_writer out(os, index);
+  while (!heap.empty()) {
+    auto r = heap.top();
+    heap.pop();
+    out.push(readers[r].front());
+    readers[r].pop();
+    if (!readers[r].empty()) heap.push(r);
+  }
+  out.finish();
+}
+
+} // namespace
+
+void build_unsorted(std::istream& text_stream, std::ostream& binary_stream,
+                    const sort_options& opts, prefix_index* index) {
+
+  unsigned threads = opts.threads != 0 ? opts.threads
+                                       : std::max(1U, std::thread::hardware_concurrency());
+  // text plus its parsed records take roughly twice the text size
+  std::size_t chunk_size = std::max<std::size_t>(opts.memory_budget / threads / 2, 1U << 20U);
+
+  run_files runs;
+
+  // phase 1: parse, sort and spill runs, `threads` at a time. Declared after `runs`, so that on
+  // exceptions, tasks are joined before their files are removed.
+  std::deque<std::future<void>> inflight;
+
+  auto collect_oldest = [&] {
+    inflight.front().get(); // rethrows
+    inflight.pop_front();
+  };
+
+  for_each_text_chunk(text_stream, chunk_size, [&](std::string chunk) {
+    if (inflight.size() == threads) collect_oldest();
+    const auto& path = runs.paths.emplace_back(runs.next_path(opts.tmpdir));
+    inflight.push_back(std::async(std::launch::async, [c = std::move(chunk), path] {
+      auto pws = parse_text(c);
+      write_run(pws, path);
+    }));
+  });
+  while (!inflight.empty()) collect_oldest();
+
+  // phase 2: reduce the fan-in with intermediate merges if required, then the final merge
+  std::size_t merged = 0;
+  while (runs.paths.size() - merged > max_fanin) {
+    // registered before it is written, so it is removed if the merge fails
+    const auto&   path = runs.paths.emplace_back(runs.next_path(opts.tmpdir));
+    std::ofstream os(path, std::ios::binary);
+    if (!os.is_open()) throw std::domain_error("cannot create sort run: " + path.string());
+    merge_runs(std::span(runs.paths).subspan(merged, max_fanin), os, opts.memory_budget,
+               nullptr);
+    if (!os) throw std::domain_error("failed writing sort run (disk full?): " + path.string());
+    os.close();
+
+    for (std::size_t i = merged; i < merged + max_fanin; ++i)
+      std::filesystem::remove(runs.paths[i]); // reclaim the space early
+    merged += max_fanin;
+  }
+  merge_runs(std::span(runs.paths).subspan(merged), binary_stream, opts.memory_budget, index);
+}
+
+} // namespace hibp
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "hibp/prefix_index.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+#include <ostream>
+
+namespace hibp {
+
+struct sort_options {
+  // approximate total RAM for text and parsed records, shared by all threads
+  std::size_t           memory_budget = std::size_t{1} << 30U;
+  std::filesystem::path tmpdir        = std::filesystem::temp_directory_path(); // for sorted runs
+  unsigned              threads       = 0; // 0 = all cores
+};
+
+// Like build(), but the text may be in any order, contain the same hash more than once (their
+// counts are summed), and be much larger than RAM. Sorted runs are generated in parallel under
+// opts.memory_budget, spilled to opts.tmpdir, then k-way merged into binary_stream.
+void build_unsorted(std::istream& text_stream, std::ostream& binary_stream,
+                    const sort_options& opts = {}, prefix_index* index = nullptr);
+
+} // namespace hibp
@@ -0,0 +1,214 @@
+#include "fuse_filter.hpp"
+#include "hibp.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+
+namespace hibp {
+
+namespace {
+
+struct filter_header {
+  std::array<char, 8> magic;
+  std::uint64_t       records; // of the db it was built from, to detect a stale filter
+  std::uint64_t       seed;
+  std::uint32_t       segment_length;
+  std::uint32_t       segment_count;
+  std::uint32_t       array_length;
+  std::uint32_t       generation; // of the db, was reserved so 0 in older files, as in their .bin
+};
+
+constexpr std::array<char, 8> filter_magic = {'H', 'I', 'B', 'P', 'F', 'U', 'S', '8'};
+
+// construction fails with probability well below 1e-6 per seed on deduplicated keys
+constexpr int max_attempts = 100;
+
+std::uint64_t splitmix64(std::uint64_t& state) {
+  std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z               = (z ^ (z >> 30U)) * 0xbf58476d1ce4e5b9ULL;
+  z               = (z ^ (z >> 27U)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31U);
+}
+
+} // namespace
+
+fuse_filter::fuse_filter(std::vector<std::uint64_t> keys) : records_(keys.size()) {
+  if (!std::is_sorted(keys.begin(), keys.end())) std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  if (keys.size() > std::numeric_limits<std::uint32_t>::max() / 2)
+    throw std::domain_error("fuse_filter: too many keys: " + std::to_string(keys.size()));
+
+  allocate(static_cast<std::uint32_t>(keys.size()));
+  populate(keys);
+}
+
+fuse_filter::fuse_filter(const std::filesystem::path& path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is.is_open()) throw std::domain_error("cannot open filter: " + path.string());
+
+  filter_header hdr{};
+  is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  if (!is || hdr.magic != filter_magic || hdr.segment_length == 0 ||
+      (hdr.segment_length & (hdr.segment_length - 1)) != 0 ||
+      hdr.array_length != (std::uint64_t{hdr.segment_count} + 2) * hdr.segment_length)
+    throw std::domain_error("not a valid hibp filter file: " + path.string());
+
+  records_              = hdr.records;
+  generation_           = hdr.generation;
+  seed_                 = hdr.seed;
+  segment_length_       = hdr.segment_length;
+  segment_length_mask_  = hdr.segment_length - 1;
+  segment_count_        = hdr.segment_count;
+  segment_count_length_ = hdr.segment_count * hdr.segment_length;
+  fingerprints_.resize(hdr.array_length);
+  is.read(reinterpret_cast<char*>(fingerprints_.data()), // NOLINT reincast
+          static_cast<std::streamsize>(fingerprints_.size()));
+  if (!is) throw std::domain_error("truncated hibp filter file: " + path.string());
+}
+
+void fuse_filter::save(const std::filesystem::path& path, std::uint32_t generation) const {
+  std::ofstream os(path, std::ios::binary);
+  if (!os.is_open()) throw std::domain_error("cannot open filter for writing: " + path.string());
+
+  filter_header hdr{.magic          = filter_magic,
+                    .records        = records_,
+                    .seed           = seed_,
+                    .segment_length = segment_length_,
+                    .segment_count  = segment_count_,
+                    .array_length   = static_cast<std::uint32_t>(fingerprints_.size()),
+                    .generation     = generation};
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  os.write(reinterpret_cast<const char*>(fingerprints_.data()), // NOLINT reincast
+           static_cast<std::streamsize>(fingerprints_.size()));
+  if (!os) throw std::domain_error("failed writing filter: " + path.string());
+}
+
+// sizing parameters for arity 3, as tuned in the paper
+void fuse_filter::allocate(std::uint32_t size) {
+  double n        = std::max(static_cast<double>(size), 2.0);
+  segment_length_ = size == 0 ? 4U
+                              : std::min(1U << static_cast<unsigned>(
+                                             std::floor(std::log(n) / std::log(3.33) + 2.25)),
+                                         1U << 18U);
+  segment_length_mask_ = segment_length_ - 1;
+
+  double size_factor = size <= 1 ? 0 : std::max(1.125, 0.875 + 0.25 * std::log(1e6) / std::log(n));
+  auto   capacity    = static_cast<std::uint32_t>(std::round(size * size_factor));
+  std::uint32_t segments = (capacity + segment_length_ - 1) / segment_length_;
+  segment_count_         = segments <= 2 ? 1 : segments - 2;
+  segment_count_length_  = segment_count_ * segment_length_;
+  fingerprints_.assign(std::size_t{segment_count_ + 2} * segment_length_, 0);
+}
+
+// Hypergraph peeling: every slot counts and xors the hashes of its keys; slots with a single key
+// are peeled off, in that order, recursively. Fingerprints are then assigned in reverse order.
+void fuse_filter::populate(std::vector<std::uint64_t>& keys) {
+  auto size     = static_cast<std::uint32_t>(keys.size());
+  auto capacity = static_cast<std::uint32_t>(fingerprints_.size());
+
+  std::vector<std::uint64_t> order(size);          // hashes, then the peeled stack
+  std::vector<std::uint8_t>  peeled_slot(size);    // which of h0,h1,h2 each peeled key owns
+  std::vector<std::uint64_t> slot_hash(capacity);  // xor of the hashes mapped to each slot
+  std::vector<std::uint8_t>  slot_count(capacity); // count << 2 | xor of the owning h index
+  std::vector<std::uint32_t> alone(capacity);      // queue of single key slots
+
+  // bucketing the hashes by their top bits, which roughly determine h0, makes the counting pass
+  // below cache friendly
+  unsigned block_bits = 1;
+  while ((1U << block_bits) < segment_count_) ++block_bits;
+  std::vector<std::uint32_t> start((std::size_t{1} << block_bits) + 1);
+
+  std::uint64_t rng        = 0x726b2b9d438b9d4dULL;
+  std::uint32_t stack_size = 0;
+  for (int attempt = 0; stack_size < size; ++attempt) {
+    if (attempt == max_attempts)
+      throw std::domain_error("fuse_filter: construction failed, duplicate keys?");
+    seed_ = splitmix64(rng);
+
+    std::fill(slot_hash.begin(), slot_hash.end(), 0);
+    std::fill(slot_count.begin(), slot_count.end(), 0);
+    std::fill(start.begin(), start.end(), 0);
+    for (auto key: keys) ++start[(mix(key + seed_) >> (64U - block_bits)) + 1];
+    std::partial_sum(start.begin(), start.end(), start.begin());
+    for (auto key: keys) {
+      std::uint64_t hash = mix(key + seed_);
+      order[start[hash >> (64U - block_bits)]++] = hash;
+    }
+
+    for (auto hash: order) {
+      auto [h0, h1, h2] = positions(hash);
+      slot_count[h0] += 4;
+      slot_hash[h0] ^= hash;
+      slot_count[h1] += 4;
+      slot_count[h1] ^= 1U;
+      slot_hash[h1] ^= hash;
+      slot_count[h2] += 4;
+      slot_count[h2] ^= 2U;
+      slot_hash[h2] ^= hash;
+    }
+
+    std::uint32_t queued = 0;
+    for (std::uint32_t i = 0; i < capacity; ++i)
+      if ((slot_count[i] >> 2U) == 1) alone[queued++] = i;
+
+    stack_size = 0;
+    while (queued > 0) {
+      std::uint32_t slot = alone[--queued];
+      if ((slot_count[slot] >> 2U) != 1) continue; // lost its last key since it was queued
+
+      std::uint64_t hash  = slot_hash[slot];
+      auto [h0, h1, h2]   = positions(hash);
+      std::array<std::uint32_t, 5> h{h0, h1, h2, h0, h1};
+      auto          found = static_cast<std::uint8_t>(slot_count[slot] & 3U);
+      peeled_slot[stack_size] = found;
+      order[stack_size++]     = hash;
+
+      for (unsigned other = 1; other <= 2; ++other) {
+        std::uint32_t o = h[found + other];
+        if ((slot_count[o] >> 2U) == 2) alone[queued++] = o;
+        slot_count[o] -= 4;
+        slot_count[o] ^= static_cast<std::uint8_t>((found + other) % 3);
+        slot_hash[o] ^= hash;
+      }
+    }
+  }
+
+  for (std::uint32_t i = size; i-- > 0;) {
+    std::uint64_t hash = order[i];
+    auto [h0, h1, h2]  = positions(hash);
+    std::array<std::uint32_t, 5> h{h0, h1, h2, h0, h1};
+    std::uint8_t found = peeled_slot[i];
+    fingerprints_[h[found]] = static_cast<std::uint8_t>(
+        (hash ^ (hash >> 32U)) ^ fingerprints_[h[found + 1]] ^ fingerprints_[h[found + 2]]);
+  }
+}
+
+namespace {
+
+template <std::size_t N>
+std::vector<std::uint64_t> prefixes(const std::filesystem::path& dbpath) {
+  basic_database<N> db(dbpath.string(), {.use_index = false, .use_filter = false});
+
+  std::vector<std::uint64_t> keys;
+  keys.reserve(db.size());
+  db.for_each([&](const basic_password<N>& pw) {
+    keys.push_back(pw.prefix());
+    return true;
+  });
+  return keys;
+}
+
+} // namespace
+
+void build_filter(const std::filesystem::path& dbpath) {
+  auto hdr  = read_header(dbpath);
+  auto keys = hdr && hdr->type == hash_type::ntlm ? prefixes<16>(dbpath) : prefixes<20>(dbpath);
+  fuse_filter(std::move(keys)).save(fuse_filter::sidecar_path(dbpath), hdr ? hdr->generation : 0);
+}
+
+} // namespace hibp
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace hibp {
+
+// Binary fuse filter with 8 bit fingerprints (Graf & Lemire 2022) over 64 bit keys. Answers
+// "definitely absent" or "probably present" (false positive rate ~0.4%) with 3 memory reads, in
+// ~1.13 bytes per key. Stored as a sidecar file next to the .bin (see sidecar_path()).
+class fuse_filter {
+public:
+  // construct over keys, which may be unsorted and contain duplicates. Needs ~25 bytes per key
+  // of temporary memory.
+  explicit fuse_filter(std::vector<std::uint64_t> keys);
+
+  // load a previously save()'d filter into RAM
+  explicit fuse_filter(const std::filesystem::path& path);
+
+  // stamped with the file_header::generation of the .bin it was built from
+  void save(const std::filesystem::path& path, std::uint32_t generation = 0) const;
+
+  [[nodiscard]] bool contains(std::uint64_t key) const {
+    std::uint64_t hash = mix(key + seed_);
+    auto          f    = static_cast<std::uint8_t>(hash ^ (hash >> 32U));
+    auto [h0, h1, h2]  = positions(hash);
+    return (f ^ fingerprints_[h0] ^ fingerprints_[h1] ^ fingerprints_[h2]) == 0;
+  }
+
+  [[nodiscard]] std::size_t size_bytes() const { return fingerprints_.size(); }
+
+  // number of keys (including duplicates) it was built from
+  [[nodiscard]] std::uint64_t records() const { return records_; }
+  [[nodiscard]] std::uint32_t generation() const { return generation_; }
+
+  static std::filesystem::path sidecar_path(const std::filesystem::path& dbpath) {
+    return dbpath.string() + ".fuse";
+  }
+
+private:
+  struct triple {
+    std::uint32_t h0, h1, h2;
+  };
+
+  // murmur3 finalizer
+  static std::uint64_t mix(std::uint64_t h) {
+    h ^= h >> 33U;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33U;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33U;
+    return h;
+  }
+
+  // the 3 slots, each in one of 3 consecutive segments
+  [[nodiscard]] triple positions(std::uint64_t hash) const {
+    __extension__ using uint128 = unsigned __int128;
+    auto h0 = static_cast<std::uint32_t>((uint128{hash} * segment_count_length_) >> 64U);
+    auto h1 = h0 + segment_length_;
+    auto h2 = h1 + segment_length_;
+    h1 ^= static_cast<std::uint32_t>(hash >> 18U) & segment_length_mask_;
+    h2 ^= static_cast<std::uint32_t>(hash) & segment_length_mask_;
+    return {h0, h1, h2};
+  }
+
+  void allocate(std::uint32_t size);
+  void populate(std::vector<std::uint64_t>& keys);
+
+  std::uint64_t             records_              = 0;
+  std::uint32_t             generation_           = 0; // loaded only, see save()
+  std::uint64_t             seed_                 = 0;
+  std::uint32_t             segment_length_       = 0;
+  std::uint32_t             segment_length_mask_  = 0;
+  std::uint32_t             segment_count_        = 0;
+  std::uint32_t             segment_count_length_ = 0;
+  std::vector<std::uint8_t> fingerprints_;
+};
+
+// (re)generate the filter sidecar over password::prefix() of every record in an existing .bin
+void build_filter(const std::filesystem::path& dbpath);
+
+} // namespace hibp
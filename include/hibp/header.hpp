@@ -0,0 +1,95 @@
+#pragma once
+
+#include "hibp/mmap.hpp"
+#include "hibp/password.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+
+namespace hibp {
+
+// order of the password records within a .bin file
+enum class layout : std::uint32_t {
+  sorted    = 0, // ascending by hash. Headerless files are always sorted
+  eytzinger = 1  // implicit search tree in BFS order: children of node k are 2k and 2k+1 (1-based)
+};
+
+// Optional header at the start of a .bin file. Files produced by a plain `build` don't have one,
+// which is how they stay compatible with earlier versions.
+struct file_header {
+  static constexpr std::array<char, 8> magic_bytes = {'H', 'I', 'B', 'P', 'B', 'I', 'N', '\0'};
+  static constexpr std::uint32_t       current_version = 4; // 2: type, 3: shards, 4: generation
+
+  std::array<char, 8>       magic       = magic_bytes;
+  std::uint32_t             version     = current_version;
+  layout                    order       = layout::sorted;
+  std::uint32_t             record_size = sizeof(password);
+  hash_type                 type        = hash_type::sha1; // was reserved, so 0 = sha1 in v1
+  // a shard of a sharded db holds the hashes whose leading shard_bits are shard. 0 = whole db
+  std::uint32_t             shard_bits  = 0;
+  std::uint32_t             shard       = 0;
+  // Bumped by every update(). Sidecars record the generation of the .bin they were built from,
+  // so one left over from another version is rejected even if the record count matches. 0 for
+  // files from before version 4, and for headerless ones.
+  std::uint32_t             generation  = 0;
+  std::array<std::byte, 28> reserved{}; // room to grow without changing the size
+};
+static_assert(sizeof(file_header) == 64, "file_header must stay 64 bytes");
+
+// checks the first bytes of dbpath, returns nullopt if they are not a header
+inline std::optional<file_header> check_header(const file_header&           hdr,
+                                               const std::filesystem::path& dbpath) {
+  if (hdr.magic != file_header::magic_bytes) return std::nullopt;
+
+  if (hdr.version > file_header::current_version)
+    throw std::domain_error("db file version " + std::to_string(hdr.version) +
+                            " is newer than this program supports: " + dbpath.string());
+  if (hdr.type != hash_type::sha1 && hdr.type != hash_type::ntlm)
+    throw std::domain_error("db file hash type " + std::to_string(static_cast<unsigned>(hdr.type)) +
+                            " is not supported: " + dbpath.string());
+  if (hdr.record_size != record_size(hdr.type))
+    throw std::domain_error("db file record size " + std::to_string(hdr.record_size) +
+                            " is not supported: " + dbpath.string());
+  return hdr;
+}
+
+// returns nullopt for headerless (legacy, sorted) files
+inline std::optional<file_header> read_header(const std::filesystem::path& dbpath) {
+  std::ifstream is(dbpath, std::ios::binary);
+  if (!is.is_open()) throw std::domain_error("cannot open db: " + dbpath.string());
+
+  file_header hdr;
+  is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  if (!is) return std::nullopt;
+  return check_header(hdr, dbpath);
+}
+
+// as above, from a file already open, so the header is certain to be that file's
+inline std::optional<file_header> read_header(const pread_file&            file,
+                                               const std::filesystem::path& dbpath) {
+  if (file.size() < sizeof(file_header)) return std::nullopt;
+  file_header hdr;
+  file.read(&hdr, sizeof(hdr), 0);
+  return check_header(hdr, dbpath);
+}
+
+// for code which handles one hash type only
+inline void require_hash_type(const std::optional<file_header>& hdr, hash_type type,
+                              const std::filesystem::path& dbpath) {
+  auto actual = hdr ? hdr->type : hash_type::sha1;
+  if (actual != type)
+    throw std::domain_error(dbpath.string() + " holds " + hash_name(actual) + " hashes, not " +
+                            hash_name(type));
+}
+
+inline void write_header(std::ostream& os, const file_header& hdr) {
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+}
+
+} // namespace hibp
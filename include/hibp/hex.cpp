@@ -0,0 +1,154 @@
+#include "hex.hpp"
+#include <cstring>
+
+#if defined(__SSE2__) // always on x86_64
+#include <immintrin.h>
+#endif
+
+namespace hibp {
+
+namespace {
+
+// '0'..'9' are 0x30..0x39, 'A'..'F' 0x41..0x46 and 'a'..'f' 0x61..0x66: the low nibble is the
+// value, plus 9 for letters, which are the ones with bit 6 set. The same holds in every lane.
+unsigned nibble(char c) {
+  auto u = static_cast<unsigned char>(c);
+  return (u & 0xFU) + 9U * ((u >> 6U) & 1U);
+}
+
+char hex_digit(unsigned n) { return static_cast<char>(n + '0' + (n > 9 ? 'A' - '0' - 10 : 0)); }
+
+void decode_scalar(const char* src, std::byte* dst, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; ++i)
+    dst[i] = static_cast<std::byte>(nibble(src[2 * i]) << 4U | nibble(src[2 * i + 1]));
+}
+
+void encode_scalar(const std::byte* src, char* dst, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; ++i) {
+    auto b         = static_cast<unsigned>(src[i]);
+    dst[2 * i]     = hex_digit(b >> 4U);
+    dst[2 * i + 1] = hex_digit(b & 0xFU);
+  }
+}
+
+#if defined(__SSE2__)
+
+// 16 characters in, 8 bytes in the low half out
+__m128i decode16(__m128i chars) {
+  const __m128i letter = _mm_cmpeq_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x40)),
+                                        _mm_set1_epi8(0x40));
+  const __m128i nibs   = _mm_add_epi8(_mm_and_si128(chars, _mm_set1_epi8(0x0F)),
+                                      _mm_and_si128(letter, _mm_set1_epi8(9)));
+  // each 16 bit lane holds a digit pair, first digit in the low byte
+  const __m128i pairs =
+      _mm_and_si128(_mm_or_si128(_mm_slli_epi16(nibs, 4), _mm_srli_epi16(nibs, 8)),
+                    _mm_set1_epi16(0xFF));
+  return _mm_packus_epi16(pairs, pairs);
+}
+
+// nibble values 0..15 in each byte to ascii
+__m128i to_ascii16(__m128i nibs) {
+  const __m128i letter = _mm_cmpgt_epi8(nibs, _mm_set1_epi8(9));
+  return _mm_add_epi8(_mm_add_epi8(nibs, _mm_set1_epi8('0')),
+                      _mm_and_si128(letter, _mm_set1_epi8('A' - '0' - 10)));
+}
+
+void decode_sse2(const char* src, std::byte* dst, std::size_t bytes) {
+  std::size_t i = 0;
+  for (; i + 8 <= bytes; i += 8) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i)); // NOLINT
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), decode16(chars));        // NOLINT
+  }
+  if (i + 4 <= bytes) { // the last 4 bytes of a sha1
+    __m128i chars = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + 2 * i)); // NOLINT
+    int     out   = _mm_cvtsi128_si32(decode16(chars));
+    std::memcpy(dst + i, &out, sizeof(out));
+    i += 4;
+  }
+  decode_scalar(src + 2 * i, dst + i, bytes - i);
+}
+
+void encode_sse2(const std::byte* src, char* dst, std::size_t bytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i b  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)); // NOLINT reincast
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), _mm_set1_epi8(0x0F));
+    __m128i lo = _mm_and_si128(b, _mm_set1_epi8(0x0F));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), // NOLINT reincast
+                     to_ascii16(_mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), // NOLINT reincast
+                     to_ascii16(_mm_unpackhi_epi8(hi, lo)));
+  }
+  if (i + 4 <= bytes) { // the last 4 bytes of a sha1
+    int in; // NOLINT initialization
+    std::memcpy(&in, src + i, sizeof(in));
+    __m128i b  = _mm_cvtsi32_si128(in);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(b, 4), _mm_set1_epi8(0x0F));
+    __m128i lo = _mm_and_si128(b, _mm_set1_epi8(0x0F));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + 2 * i), // NOLINT reincast
+                     to_ascii16(_mm_unpacklo_epi8(hi, lo)));
+    i += 4;
+  }
+  encode_scalar(src + i, dst + 2 * i, bytes - i);
+}
+
+[[gnu::target("avx2")]] void decode_avx2(const char* src, std::byte* dst, std::size_t bytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    __m256i chars  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i)); // NOLINT
+    __m256i letter = _mm256_cmpeq_epi8(_mm256_and_si256(chars, _mm256_set1_epi8(0x40)),
+                                       _mm256_set1_epi8(0x40));
+    __m256i nibs   = _mm256_add_epi8(_mm256_and_si256(chars, _mm256_set1_epi8(0x0F)),
+                                     _mm256_and_si256(letter, _mm256_set1_epi8(9)));
+    __m256i pairs  = _mm256_and_si256(
+        _mm256_or_si256(_mm256_slli_epi16(nibs, 4), _mm256_srli_epi16(nibs, 8)),
+        _mm256_set1_epi16(0xFF));
+    // packus works within 128 bit lanes, so pack the two halves against each other
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), // NOLINT reincast
+                     _mm_packus_epi16(_mm256_castsi256_si128(pairs),
+                                      _mm256_extracti128_si256(pairs, 1)));
+  }
+  _mm256_zeroupper(); // gcc omits it before the tail call, and legacy SSE would then stall
+  decode_sse2(src + 2 * i, dst + i, bytes - i);
+}
+
+[[gnu::target("avx2")]] void encode_avx2(const std::byte* src, char* dst, std::size_t bytes) {
+  std::size_t i = 0;
+  for (; i + 16 <= bytes; i += 16) {
+    // one byte per 16 bit lane, becomes its high digit in the low byte, low digit in the high
+    __m256i b      = _mm256_cvtepu8_epi16(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))); // NOLINT reincast
+    __m256i nibs   = _mm256_or_si256(
+        _mm256_srli_epi16(b, 4), _mm256_slli_epi16(_mm256_and_si256(b, _mm256_set1_epi16(0xF)), 8));
+    __m256i letter = _mm256_cmpgt_epi8(nibs, _mm256_set1_epi8(9));
+    __m256i ascii  = _mm256_add_epi8(_mm256_add_epi8(nibs, _mm256_set1_epi8('0')),
+                                     _mm256_and_si256(letter, _mm256_set1_epi8('A' - '0' - 10)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), ascii); // NOLINT reincast
+  }
+  _mm256_zeroupper();
+  encode_sse2(src + i, dst + 2 * i, bytes - i);
+}
+
+#endif
+
+} // namespace
+
+void hex_decode(const char* src, std::byte* dst, std::size_t bytes) {
+#if defined(__SSE2__)
+  static const auto best = __builtin_cpu_supports("avx2") ? decode_avx2 : decode_sse2;
+  best(src, dst, bytes);
+#else
+  decode_scalar(src, dst, bytes);
+#endif
+}
+
+void hex_encode(const std::byte* src, char* dst, std::size_t bytes) {
+#if defined(__SSE2__)
+  static const auto best = __builtin_cpu_supports("avx2") ? encode_avx2 : encode_sse2;
+  best(src, dst, bytes);
+#else
+  encode_scalar(src, dst, bytes);
+#endif
+}
+
+} // namespace hibp
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+namespace hibp {
+
+// Hex conversion of hashes, 16 or 32 characters per vector instruction (SSE2, or AVX2 where the
+// cpu has it). Decoding accepts upper and lower case and, like make_nibble, does not validate:
+// other characters decode to garbage. Encoding writes upper case, as in the hibp text files.
+
+// 2 * bytes hex characters at src to bytes at dst
+void hex_decode(const char* src, std::byte* dst, std::size_t bytes);
+
+// bytes at src to 2 * bytes hex characters at dst
+void hex_encode(const std::byte* src, char* dst, std::size_t bytes);
+
+} // namespace hibp
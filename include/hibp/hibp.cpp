@@ -0,0 +1,637 @@
+#include "hibp.hpp"
+#include "count_index.hpp"
+#include "hex.hpp"
+#include "uring.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+template <std::size_t N>
+std::vector<basic_password<N>> parse_text(std::string_view text) {
+  std::vector<basic_password<N>> pws;
+  pws.reserve(text.size() / 45); // typical line is "<40 hex>:<count>\r\n"
+  while (!text.empty()) {
+    auto nl   = text.find('\n');
+    auto line = text.substr(0, nl);
+    if (line.size() >= N * 2) pws.emplace_back(line);
+    if (nl == std::string_view::npos) break;
+    text.remove_prefix(nl + 1);
+  }
+  return pws;
+}
+
+template std::vector<password>      parse_text<20>(std::string_view text);
+template std::vector<ntlm_password> parse_text<16>(std::string_view text);
+
+template <std::size_t N>
+void build(std::istream& text_stream, std::ostream& binary_stream, prefix_index* index,
+           count_index* counts, unsigned threads) {
+  if constexpr (N != 20)
+    write_header(binary_stream,
+                 {.record_size = sizeof(basic_password<N>), .type = basic_password<N>::type});
+
+  // chunks arrive in order, so the output stays sorted, and each is written with one large write
+  for_each_parsed_chunk<N>(text_stream, threads, [&](std::vector<basic_password<N>> pws) {
+    if (index != nullptr)
+      for (auto&& pw: pws) index->add(pw);
+    if (counts != nullptr)
+      for (auto&& pw: pws) counts->add(pw);
+    binary_stream.write(reinterpret_cast<const char*>(pws.data()), // NOLINT reincast
+                        static_cast<std::streamsize>(sizeof(basic_password<N>) * pws.size()));
+  });
+}
+
+template void build<20>(std::istream& text_stream, std::ostream& binary_stream,
+                        prefix_index* index, count_index* counts, unsigned threads);
+template void build<16>(std::istream& text_stream, std::ostream& binary_stream,
+                        prefix_index* index, count_index* counts, unsigned threads);
+
+namespace {
+
+template <std::size_t N>
+void export_records(const std::filesystem::path& dbpath, std::ostream& text_stream) {
+  basic_database<N> db(dbpath.string(), {.use_index = false, .use_filter = false});
+  if (db.get_layout() != layout::sorted)
+    throw std::domain_error("export requires a sorted db: " + dbpath.string());
+
+  constexpr std::size_t flush_size = 1U << 20U;
+  constexpr std::size_t max_line   = 2 * N + 1 + 11 + 2; // int32 count is at most 11 chars
+  std::vector<char>     buf(flush_size + max_line);
+  std::size_t           used = 0;
+  db.for_each([&](const basic_password<N>& pw) {
+    char* p = buf.data() + used;
+    hex_encode(pw.hash.data(), p, N);
+    p += 2 * N;
+    *p++ = ':';
+    p    = std::to_chars(p, p + 11, pw.count).ptr;
+    *p++ = '\r';
+    *p++ = '\n';
+    used = static_cast<std::size_t>(p - buf.data());
+    if (used >= flush_size) {
+      text_stream.write(buf.data(), static_cast<std::streamsize>(used));
+      used = 0;
+    }
+    return true;
+  });
+  text_stream.write(buf.data(), static_cast<std::streamsize>(used));
+  if (!text_stream) throw std::domain_error("failed writing text for " + dbpath.string());
+}
+
+// Sorted rank of the 1-based eytzinger node k in a tree of n nodes. Levels 0..H-1 are complete,
+// level H holds the remaining m nodes, packed to the left. In the perfect tree of height H, the
+// in-order position of node i (0-based) on level d is (2i+1)*2^(H-d)-1 and leaves sit at even
+// positions. Subtract the missing leaves which would have come before.
+std::size_t eytzinger_rank(std::size_t k, std::size_t n) {
+  auto        height = static_cast<unsigned>(std::bit_width(n) - 1);
+  auto        depth  = static_cast<unsigned>(std::bit_width(k) - 1);
+  std::size_t m      = n - ((std::size_t{1} << height) - 1);
+  std::size_t i      = k - (std::size_t{1} << depth);
+  if (depth == height) return 2 * i;
+
+  std::size_t pos    = ((2 * i + 1) << (height - depth)) - 1;
+  std::size_t leaves = (pos + 1) / 2; // leaf slots before pos
+  return leaves > m ? pos - (leaves - m) : pos;
+}
+
+} // namespace
+
+void export_text(const std::filesystem::path& dbpath, std::ostream& text_stream) {
+  if (auto hdr = read_header(dbpath); hdr && hdr->type == hash_type::ntlm)
+    export_records<16>(dbpath, text_stream);
+  else
+    export_records<20>(dbpath, text_stream);
+}
+
+void build_eytzinger(const std::filesystem::path& sorted_dbpath,
+                     const std::filesystem::path& eytzinger_dbpath) {
+  auto hdr = read_header(sorted_dbpath);
+  require_hash_type(hdr, hash_type::sha1, sorted_dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("input db is not sorted: " + sorted_dbpath.string());
+  std::size_t offset = hdr ? sizeof(file_header) : 0;
+
+  mmap_file map(sorted_dbpath); // default kernel read-ahead suits the forward strided reads
+  if ((map.size() - offset) % sizeof(password) != 0)
+    throw std::domain_error("db file size is not a multiple of the record size");
+  std::size_t n      = (map.size() - offset) / sizeof(password);
+  const auto* sorted = reinterpret_cast<const password*>(map.data() + offset); // NOLINT reincast
+
+  std::ofstream os(eytzinger_dbpath, std::ios::binary);
+  if (!os.is_open())
+    throw std::domain_error("cannot open `" + eytzinger_dbpath.string() + "` for writing");
+
+  write_header(os, {.order = layout::eytzinger});
+
+  // every level reads the input front to back, 2^(H-d+1) apart
+  constexpr std::size_t obufcnt = 1U << 16U;
+  std::vector<password> obuf;
+  obuf.reserve(obufcnt);
+  for (std::size_t k = 1; k <= n; ++k) {
+    obuf.push_back(sorted[eytzinger_rank(k, n)]);
+    if (obuf.size() == obufcnt || k == n) {
+      os.write(reinterpret_cast<const char*>(obuf.data()), // NOLINT reincast
+               static_cast<std::streamsize>(sizeof(password) * obuf.size()));
+      obuf.clear();
+    }
+  }
+  if (!os) throw std::domain_error("failed writing `" + eytzinger_dbpath.string() + "`");
+}
+
+// hibp::database
+
+template <std::size_t N>
+basic_database<N>::basic_database(std::string dbfilename, db_options opts)
+    : dbfilename_(std::move(dbfilename)), dbpath_(dbfilename_), opts_(opts) {
+
+  // The one open of dbpath: size, header and records all come from this file, even if update()
+  // renames another over dbpath meanwhile.
+  pread_file file(dbpath_);
+  dbfsize_ = file.size();
+
+  auto hdr = read_header(file, dbpath_);
+  require_hash_type(hdr, record::type, dbpath_);
+  if (hdr) {
+    layout_      = hdr->order;
+    data_offset_ = sizeof(file_header);
+    generation_  = hdr->generation;
+  }
+
+  if ((dbfsize_ - data_offset_) % sizeof(record) != 0)
+    throw std::domain_error("db file size is not a multiple of the record size");
+
+  dbsize_ = (dbfsize_ - data_offset_) / sizeof(record);
+
+  if (opts_.acc == access::mmap) {
+    map_     = mmap_file(file, dbpath_);
+    records_ = reinterpret_cast<const record*>(map_.data() + data_offset_); // NOLINT reincast
+    // bisection jumps all over the file: kernel read-ahead would only pollute the page cache
+    map_.advise(MADV_RANDOM);
+    if (opts_.preload) map_.lock();
+  } else if (opts_.acc == access::pread || opts_.acc == access::uring) {
+    if (opts_.acc == access::uring && !uring::supported())
+      throw std::domain_error("io_uring is not available on this system");
+    file_ = std::move(file);
+    file_.advise(POSIX_FADV_RANDOM); // as for mmap
+  } else {
+    // reopens the open file itself, not whatever dbpath names by now
+    db_.open("/dev/fd/" + std::to_string(file.native_handle()), std::ios::binary);
+    if (!db_.is_open()) throw std::domain_error("cannot open db: " + std::string(dbpath_));
+  }
+
+  // bucket ranges only make sense for sorted files
+  if (auto idxpath = prefix_index::sidecar_path(dbpath_);
+      opts_.use_index && layout_ == layout::sorted && std::filesystem::exists(idxpath)) {
+    index_.emplace(idxpath);
+    if (index_->records() != dbsize_ || index_->generation() != generation_)
+      throw std::domain_error("stale index: " + idxpath.string() + " does not match " +
+                              dbfilename_ + ". Rebuild it with `hibp index`");
+  }
+
+  if (opts_.strat == strategy::learned && layout_ == layout::sorted) {
+    auto splpath = spline_index::sidecar_path(dbpath_);
+    if (!std::filesystem::exists(splpath))
+      throw std::domain_error("no learned index: " + splpath.string() +
+                              ". Build it with `hibp spline`");
+    spline_.emplace(splpath);
+    if (spline_->records() != dbsize_ || spline_->generation() != generation_)
+      throw std::domain_error("stale learned index: " + splpath.string() + " does not match " +
+                              dbfilename_ + ". Rebuild it with `hibp spline`");
+  }
+
+  if (auto fusepath = fuse_filter::sidecar_path(dbpath_);
+      opts_.use_filter && std::filesystem::exists(fusepath)) {
+    filter_.emplace(fusepath);
+    if (filter_->records() != dbsize_ || filter_->generation() != generation_)
+      throw std::domain_error("stale filter: " + fusepath.string() + " does not match " +
+                              dbfilename_ + ". Rebuild it with `hibp filter`");
+  }
+}
+
+template <std::size_t N>
+std::unique_lock<std::mutex> basic_database<N>::lock_stream() const {
+  if (opts_.acc == access::stream) return std::unique_lock(db_mutex_);
+  return {};
+}
+
+template <std::size_t N>
+basic_password<N> basic_database<N>::read(std::size_t pos, std::size_t& probes) const {
+  ++probes;
+  if (records_ != nullptr) return records_[pos];
+  if (file_.is_open()) {
+    record pw;
+    file_.read(&pw, sizeof(pw), data_offset_ + pos * sizeof(record));
+    return pw;
+  }
+  return {db_, pos, data_offset_};
+}
+
+template <std::size_t N>
+basic_password<N> basic_database<N>::get(std::size_t pos) const {
+  auto        lock   = lock_stream();
+  std::size_t probes = 0;
+  record      pw     = read(pos, probes);
+  probes_.fetch_add(probes, std::memory_order_relaxed);
+  return pw;
+}
+
+template <std::size_t N>
+std::size_t basic_database<N>::lower_bound(const record& needle, std::size_t first,
+                                           std::size_t last, std::size_t& probes) const {
+  std::size_t count = last - first;
+  // lower_bound binary search algo
+  while (count > 0) {
+    std::size_t pos  = first;
+    std::size_t step = count / 2;
+    pos += step;
+    record cur = read(pos, probes);
+    if (cur < needle) { // NOLINT weird nullptr warning
+      first = ++pos;
+      count -= step + 1;
+    } else
+      count = step;
+  }
+  return first;
+}
+
+// Interpolation search on password::prefix(). Keys in [first, last) are known to lie within
+// [lokey, hikey], and each probe tightens both the range and the key bounds. On uniform data
+// each probe lands much closer to the target than the last one. Fall back to bisection for
+// small ranges, or when that stops happening (distribution locally skewed).
+template <std::size_t N>
+std::size_t basic_database<N>::interpolate(const record& needle, std::size_t first,
+                                           std::size_t last, double lokey, double hikey,
+                                           std::size_t& probes) const {
+  constexpr std::size_t min_range = 4; // bisection is just as good down here
+
+  const auto  key       = static_cast<double>(needle.prefix());
+  std::size_t prevpos   = first;
+  std::size_t prevjump  = std::numeric_limits<std::size_t>::max(); // first jump: no check
+  int         bad_steps = 0;
+  while (last - first > min_range && bad_steps < 2 && hikey > lokey) {
+    std::size_t n    = last - first;
+    double      frac = (key - lokey) / (hikey - lokey);
+    auto        off  = static_cast<std::size_t>(frac * static_cast<double>(n));
+    std::size_t pos  = first + std::min(off, n - 1);
+
+    std::size_t jump = pos > prevpos ? pos - prevpos : prevpos - pos;
+    if (jump > prevjump / 2) ++bad_steps;
+    prevjump = jump;
+    prevpos  = pos;
+
+    record cur = read(pos, probes);
+    if (cur < needle) { // NOLINT weird nullptr warning
+      first = pos + 1;
+      lokey = static_cast<double>(cur.prefix());
+    } else if (needle < cur) {
+      last  = pos;
+      hikey = static_cast<double>(cur.prefix());
+    } else {
+      return pos; // hashes are unique, so this is also the lower_bound
+    }
+  }
+  return lower_bound(needle, first, last, probes);
+}
+
+// Branchless descent of the implicit tree, k is 1-based, stored at k-1. When we fall off the
+// bottom, the path taken encodes the lower_bound: strip the trailing right turns (1 bits) and
+// the final left turn. The top levels are shared by all searches and stay hot in cache, and the
+// 4 grandchildren of a node are adjacent, so they can be prefetched two levels ahead.
+template <std::size_t N>
+std::optional<basic_password<N>>
+basic_database<N>::search_eytzinger(const record& needle, std::size_t& probes) const {
+  std::size_t k = 1;
+  while (k <= dbsize_) {
+    if (records_ != nullptr && 4 * k - 1 < dbsize_) {
+      const auto* grandchildren = reinterpret_cast<const char*>(&records_[4 * k - 1]); // NOLINT
+      __builtin_prefetch(grandchildren);
+      __builtin_prefetch(grandchildren + 64);
+      // last byte of the 4 records, 80 or 96 bytes span up to 3 cache lines
+      __builtin_prefetch(grandchildren + 4 * sizeof(record) - 1);
+    }
+    k = 2 * k + static_cast<std::size_t>(read(k - 1, probes) < needle);
+  }
+  k >>= std::countr_one(k) + 1;
+  if (k == 0) return std::nullopt; // needle is greater than all records
+
+  record found = read(k - 1, probes);
+  if (found == needle) return found;
+  return std::nullopt;
+}
+
+// The whole window in one read, then bisected in RAM. Within it, mmap bisects in place: the
+// window spans at most a few pages.
+template <std::size_t N>
+std::optional<basic_password<N>> basic_database<N>::search_window(const record& needle,
+                                                                  std::size_t   first,
+                                                                  std::size_t   last,
+                                                                  std::size_t&  probes) const {
+  auto lookup = [&](const record* window) -> std::optional<record> {
+    const record* found = std::lower_bound(window, window + (last - first), needle);
+    if (found != window + (last - first) && *found == needle) return *found;
+    return std::nullopt;
+  };
+
+  ++probes;
+  if (records_ != nullptr) return lookup(records_ + first);
+
+  std::array<record, 2 * spline_index::max_error + 6> buf; // NOLINT initialization
+  if (file_.is_open()) {
+    file_.read(buf.data(), (last - first) * sizeof(record), data_offset_ + first * sizeof(record));
+  } else {
+    db_.clear();
+    db_.seekg(static_cast<long>(data_offset_ + first * sizeof(record)));
+    db_.read(reinterpret_cast<char*>(buf.data()), // NOLINT reincast
+             static_cast<std::streamsize>((last - first) * sizeof(record)));
+    if (!db_) throw std::domain_error("failed reading db: " + dbfilename_);
+  }
+  return lookup(buf.data());
+}
+
+template <std::size_t N>
+std::pair<std::size_t, std::size_t> basic_database<N>::candidates(const record& needle) const {
+  if (spline_) return spline_->range(needle);
+  if (index_) return index_->range(needle);
+  return {0, dbsize_};
+}
+
+template <std::size_t N>
+std::optional<basic_password<N>> basic_database<N>::search(record needle) const {
+  // most lookups of a breach corpus are misses: answer those without touching the .bin
+  if (filter_ && !filter_->contains(needle.prefix())) return std::nullopt;
+
+  auto        lock   = lock_stream();
+  std::size_t probes = 0;
+  auto        found  = find(needle, probes);
+  probes_.fetch_add(probes, std::memory_order_relaxed);
+  return found;
+}
+
+template <std::size_t N>
+std::optional<basic_password<N>> basic_database<N>::find(const record& needle,
+                                                         std::size_t&  probes) const {
+  if (layout_ == layout::eytzinger) return search_eytzinger(needle, probes);
+  if (spline_) {
+    auto [first, last] = spline_->range(needle);
+    if (first == last) return std::nullopt;
+    return search_window(needle, first, last, probes);
+  }
+
+  std::size_t first = 0;
+  std::size_t last  = dbsize_;
+  // key bounds implied by the prefix of the range. 2^64 is not representable in uint64
+  double lokey = 0.0;
+  double hikey = std::ldexp(1.0, 64);
+  if (index_) {
+    std::tie(first, last) = index_->range(needle);
+    auto bucket           = static_cast<double>(index_->bucket(needle));
+    lokey                 = std::ldexp(bucket, 64 - static_cast<int>(index_->bits()));
+    hikey                 = std::ldexp(bucket + 1, 64 - static_cast<int>(index_->bits()));
+  }
+
+  if (opts_.strat == strategy::interpolate)
+    first = interpolate(needle, first, last, lokey, hikey, probes);
+  else
+    first = lower_bound(needle, first, last, probes);
+  if (first < last) {
+    record found = read(first, probes);
+    if (found == needle) return found;
+  }
+  return std::nullopt;
+}
+
+// exponential search forward from the previous needle's lower_bound, then bisect the last gap.
+// Cost is ~2*log2(distance), so dense batches degrade gracefully to a forward scan.
+template <std::size_t N>
+void basic_database<N>::gallop(std::span<const record>      needles,
+                               std::span<const std::size_t> order,
+                               std::vector<std::optional<record>>& results) const {
+  auto        lock   = lock_stream();
+  std::size_t probes = 0;
+  std::size_t cursor = 0;
+  for (auto i: order) {
+    const record& needle = needles[i];
+
+    auto [first, last] = candidates(needle);
+    first              = std::max(first, cursor);
+
+    std::size_t lo = first;
+    std::size_t hi = last;
+    for (std::size_t bound = 1; first + bound - 1 < last; bound *= 2) {
+      std::size_t pos = first + bound - 1;
+      if (read(pos, probes) < needle) {
+        lo = pos + 1;
+      } else {
+        hi = pos + 1;
+        break;
+      }
+    }
+    cursor = lower_bound(needle, lo, hi, probes);
+    if (cursor < last) {
+      record found = read(cursor, probes);
+      if (found == needle) results[i] = found;
+    }
+  }
+  probes_.fetch_add(probes, std::memory_order_relaxed);
+}
+
+template <std::size_t N>
+void basic_database<N>::merge_join(std::span<const record>      needles,
+                                   std::span<const std::size_t> order,
+                                   std::vector<std::optional<record>>& results) const {
+  auto        it     = order.begin();
+  std::size_t probes = 0; // every record read, up to the last needle
+  for_each([&](const record& pw) {
+    ++probes;
+    while (it != order.end() && needles[*it] < pw) ++it;
+    while (it != order.end() && needles[*it] == pw) results[*it++] = pw;
+    return it != order.end();
+  });
+  probes_.fetch_add(probes, std::memory_order_relaxed);
+}
+
+// Every lookup runs its own search, but instead of waiting for each read, up to
+// opts_.queue_depth lookups are kept in flight, each with one outstanding read. A completion
+// advances its lookup by one step, and the next read is queued straight away. Cold-cache
+// throughput then scales with the queue depth the device sustains, not with its latency.
+template <std::size_t N>
+void basic_database<N>::search_uring(std::span<const record>      needles,
+                                     std::span<const std::size_t> order,
+                                     std::vector<std::optional<record>>& results) const {
+  struct lookup {
+    std::size_t i;           // into needles
+    std::size_t first = 0;   // layout::sorted: lower_bound state as for lower_bound()
+    std::size_t count = 0;
+    std::size_t k     = 1;   // layout::eytzinger: 1-based tree node
+    std::size_t pos   = 0;   // record being read
+    record      buf{};
+  };
+
+  if (order.empty()) return;
+
+  auto depth = static_cast<unsigned>(std::min<std::size_t>(opts_.queue_depth, order.size()));
+  // the kernel reads into slots, so they must outlive the ring: declared first, destroyed last
+  std::vector<lookup> slots(std::max(depth, 1U));
+  uring               ring(std::max(depth, 1U)); // one per call: rings are not thread safe
+
+  std::size_t next     = 0; // into order
+  unsigned    inflight = 0;
+  std::size_t probes   = 0;
+  std::string error;
+
+  auto queue = [&](std::size_t s) {
+    lookup& l = slots[s];
+    l.pos     = layout_ == layout::eytzinger ? l.k - 1 : l.first + l.count / 2;
+    if (!ring.prep_read(file_.native_handle(), &l.buf, sizeof(record),
+                        data_offset_ + l.pos * sizeof(record), s))
+      throw std::domain_error("io_uring submission queue full"); // can't happen: one per slot
+    ++inflight;
+  };
+
+  // start the next needle with a non-empty search range in slot s, if there is one
+  auto start = [&](std::size_t s) {
+    while (next < order.size()) {
+      lookup& l = slots[s];
+      l         = {.i = order[next++]};
+      if (layout_ == layout::sorted) {
+        auto [first, last] = candidates(needles[l.i]);
+        l.first            = first;
+        l.count            = last - first;
+        if (l.count == 0) continue;
+      } else if (dbsize_ == 0) {
+        continue;
+      }
+      queue(s);
+      return;
+    }
+  };
+
+  // One step of lower_bound() or search_eytzinger(). Hashes are unique and every search path
+  // passes through the needle if it is present, so testing each probe for equality is enough,
+  // and no final read is needed. Returns false when the lookup is complete.
+  auto step = [&](lookup& l) {
+    const record& needle = needles[l.i];
+    if (l.buf == needle) {
+      results[l.i] = l.buf;
+      return false;
+    }
+    if (layout_ == layout::eytzinger) {
+      l.k = 2 * l.k + static_cast<std::size_t>(l.buf < needle);
+      return l.k <= dbsize_;
+    }
+    std::size_t half = l.count / 2;
+    if (l.buf < needle) {
+      l.first = l.pos + 1;
+      l.count -= half + 1;
+    } else {
+      l.count = half;
+    }
+    return l.count > 0;
+  };
+
+  // on an exception, let the reads in flight land before slots is released
+  auto drain = [&] {
+    std::uint64_t tag = 0;
+    int           res = 0;
+    try {
+      while (inflight > 0) {
+        ring.submit_and_wait(1);
+        while (inflight > 0 && ring.pop_completion(tag, res)) --inflight;
+      }
+    } catch (...) {
+      // they may land any time after the ring is closed: leak the buffers rather than free them
+      new std::vector<lookup>(std::move(slots)); // NOLINT deliberate leak, keeps the same buffer
+    }
+  };
+
+  try {
+    for (std::size_t s = 0; s < slots.size(); ++s) start(s);
+    while (inflight > 0) {
+      ring.submit_and_wait(1);
+      std::uint64_t tag = 0;
+      int           res = 0;
+      while (ring.pop_completion(tag, res)) {
+        --inflight;
+        lookup& l = slots[tag];
+        if (res != static_cast<int>(sizeof(record))) {
+          // stop queueing, but let the reads in flight land before slots is released
+          if (error.empty())
+            error =
+                res < 0 ? std::strerror(-res) : "short read at record " + std::to_string(l.pos);
+          continue;
+        }
+        ++probes;
+        if (!error.empty()) continue;
+        if (step(l))
+          queue(tag);
+        else
+          start(tag);
+      }
+    }
+  } catch (...) {
+    drain();
+    throw;
+  }
+  probes_.fetch_add(probes, std::memory_order_relaxed);
+  if (!error.empty()) throw std::domain_error("failed reading db: " + dbfilename_ + ": " + error);
+}
+
+template <std::size_t N>
+std::vector<std::optional<basic_password<N>>>
+basic_database<N>::search_batch(std::span<const record> needles) const {
+  // with at least one needle per this many records, galloping would touch every page anyway
+  constexpr std::size_t merge_join_density = 64;
+
+  std::vector<std::optional<record>> results(needles.size());
+
+  std::vector<std::size_t> order;
+  order.reserve(needles.size());
+  for (std::size_t i = 0; i < needles.size(); ++i)
+    if (!filter_ || filter_->contains(needles[i].prefix())) order.push_back(i);
+  std::sort(order.begin(), order.end(),
+            [&](std::size_t a, std::size_t b) { return needles[a] < needles[b]; });
+
+  if (opts_.acc == access::uring &&
+      (layout_ == layout::eytzinger || order.size() * merge_join_density < dbsize_)) {
+    search_uring(needles, order, results);
+  } else if (layout_ == layout::eytzinger) {
+    // no sequential order to exploit, but sorted needles keep the shared descent paths hot
+    auto        lock   = lock_stream();
+    std::size_t probes = 0;
+    for (auto i: order) results[i] = search_eytzinger(needles[i], probes);
+    probes_.fetch_add(probes, std::memory_order_relaxed);
+  } else if (order.size() * merge_join_density >= dbsize_) {
+    merge_join(needles, order, results);
+  } else {
+    gallop(needles, order, results);
+  }
+  return results;
+}
+
+template <std::size_t N>
+std::optional<basic_password<N>>
+basic_database<N>::search(const std::string& pw_hash_txt) const {
+  record needle(pw_hash_txt);
+  return search(needle);
+}
+
+template class basic_database<20>;
+template class basic_database<16>;
+
+} // namespace hibp
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "hibp/fuse_filter.hpp"
+#include "hibp/header.hpp"
+#include "hibp/mmap.hpp"
+#include "hibp/password.hpp"
+#include "hibp/prefix_index.hpp"
+#include "hibp/spline_index.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+// parse all complete lines of hibp text. Blank or short lines (eg a trailing newline) are skipped
+template <std::size_t N = 20>
+std::vector<basic_password<N>> parse_text(std::string_view text);
+
+// Read text_stream in blocks of chunk_size, cut back to the last newline (the tail is carried into
+// the next block) and call func(std::string chunk) for each.
+template <typename Func>
+void for_each_text_chunk(std::istream& text_stream, std::size_t chunk_size, Func func) {
+  std::string carry;
+  while (text_stream) {
+    std::string chunk = std::move(carry);
+    std::size_t used  = chunk.size();
+    chunk.resize(used + chunk_size);
+    text_stream.read(chunk.data() + used, static_cast<std::streamsize>(chunk_size));
+    chunk.resize(used + static_cast<std::size_t>(text_stream.gcount()));
+
+    auto lastnl = chunk.rfind('\n');
+    if (lastnl == std::string::npos) { // no complete line yet
+      carry = std::move(chunk);
+      continue;
+    }
+    carry.assign(chunk, lastnl + 1);
+    chunk.resize(lastnl + 1);
+    func(std::move(chunk));
+  }
+  if (!carry.empty()) func(std::move(carry)); // last line without newline
+}
+
+// Parse hibp text on `threads` cores (0 = all), one chunk per thread, and call
+// func(std::vector<basic_password<N>> records) for each chunk in input order. Memory use is
+// bounded to a few chunks per thread.
+template <std::size_t N, typename Func>
+void for_each_parsed_chunk(std::istream& text_stream, unsigned threads, Func func) {
+  constexpr std::size_t chunk_size = 16U << 20U;
+  if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+
+  std::deque<std::future<std::vector<basic_password<N>>>> inflight;
+
+  auto oldest = [&] {
+    auto pws = inflight.front().get();
+    inflight.pop_front();
+    func(std::move(pws));
+  };
+
+  for_each_text_chunk(text_stream, chunk_size, [&](std::string chunk) {
+    if (inflight.size() == threads) oldest();
+    inflight.push_back(
+        std::async(std::launch::async, [c = std::move(chunk)] { return parse_text<N>(c); }));
+  });
+
+  while (!inflight.empty()) oldest();
+}
+
+class count_index;
+
+// Convert the sorted hibp text file to a .bin of N byte hashes, parsing on `threads` cores (0 =
+// all). If index and/or counts are given, every record written is also added to them. sha1 files
+// are written without a header, as they always were, others with one which records their
+// hash_type.
+template <std::size_t N = 20>
+void build(std::istream& text_stream, std::ostream& binary_stream, prefix_index* index = nullptr,
+           count_index* counts = nullptr, unsigned threads = 0);
+
+// The inverse of build: write a sorted .bin of either hash type as hibp text, "HASH:count\r\n"
+// per record, with vectorised hex encoding and large sequential reads and writes.
+void export_text(const std::filesystem::path& dbpath, std::ostream& text_stream);
+
+// rewrite a sorted sha1 .bin in layout::eytzinger order. Output is written sequentially, the
+// input is read in forward strides, one pass per tree level.
+void build_eytzinger(const std::filesystem::path& sorted_dbpath,
+                     const std::filesystem::path& eytzinger_dbpath);
+
+// how the database reads records from the .bin file
+enum class access {
+  stream, // std::ifstream seekg + read per probe. Concurrent searches take turns
+  pread,  // pread() per probe, no shared file position
+  mmap,   // whole file mapped, records compared in place
+  uring   // as pread, but search_batch keeps many lookups in flight through io_uring (Linux)
+};
+
+// how the database locates a record within the (possibly index narrowed) range of a
+// layout::sorted file. layout::eytzinger files always use their own tree descent.
+enum class strategy {
+  bisect,      // classic lower_bound, ~log2(n) probes
+  interpolate, // guess the position from the uniform hash value, ~log2(log2(n)) probes
+  learned      // predict it with the <dbfile>.spl sidecar, then read the window around it: 1 probe
+};
+
+struct db_options {
+  access   acc   = access::stream;
+  strategy strat = strategy::bisect;
+  // mmap only: read the whole file ahead and mlock it, so searches never hit the disk
+  bool preload = false;
+  // narrow each search to one prefix bucket using the <dbfile>.idx sidecar, if present
+  bool use_index = true;
+  // reject most misses in RAM using the <dbfile>.fuse sidecar, if present
+  bool use_filter = true;
+  // access::uring only: lookups in flight at once, ie the I/O queue depth of search_batch
+  unsigned queue_depth = 128;
+};
+
+// Searches a .bin of N byte hashes, see database and ntlm_database. All members except db() are
+// const and safe to call from many threads at once. With access::pread, access::mmap and
+// access::uring readers share no mutable state, access::stream serialises them on its one file
+// position. The .bin is opened once, so a database reads one version of it throughout, even while
+// update() renames a new one over it, and sidecars of any other version (file_header::generation)
+// are rejected.
+template <std::size_t N>
+class basic_database {
+public:
+  using record = basic_password<N>;
+
+  explicit basic_database(std::string dbfilename, db_options opts = {});
+
+  std::optional<record> search(record needle) const;
+  std::optional<record> search(const std::string& pw_hash_txt) const; // hex hash
+
+  // Look up many needles at once, results are in input order. The needles are sorted and the
+  // file is walked once in ascending order: galloping forward from the previous hit for sparse
+  // batches, or a sequential merge join for dense ones. With access::uring, sparse batches are
+  // instead searched concurrently, one read per lookup in flight.
+  std::vector<std::optional<record>> search_batch(std::span<const record> needles) const;
+
+  // call func(const record&) for every record in file order, with large sequential reads.
+  // Stops early if func returns false. With access::stream, func must not search this database.
+  // With access::mmap the walk prefetches the mapping a window ahead, leaving the random access
+  // advice concurrent searches rely on in place.
+  template <typename Func>
+  void for_each(Func func) const;
+
+  std::ifstream& db() { return db_; }
+
+  // record at pos in file order, which depends on get_layout()
+  record get(std::size_t pos) const;
+
+  [[nodiscard]] std::size_t size() const { return dbsize_; }
+  [[nodiscard]] access      get_access() const { return opts_.acc; }
+  [[nodiscard]] layout      get_layout() const { return layout_; }
+  [[nodiscard]] bool        has_index() const { return index_.has_value(); }
+  [[nodiscard]] bool        has_filter() const { return filter_.has_value(); }
+
+  // file_header::generation, 0 for headerless files
+  [[nodiscard]] std::uint32_t generation() const { return generation_; }
+
+  // total records read by all searches so far, to compare strategies
+  [[nodiscard]] std::size_t probes() const { return probes_.load(std::memory_order_relaxed); }
+
+private:
+  // held for the duration of each public call with access::stream, empty otherwise
+  [[nodiscard]] std::unique_lock<std::mutex> lock_stream() const;
+
+  // The search algorithms count their probes in a local, which is added to probes_ once per
+  // call, so threads don't contend on it for every record read.
+  record read(std::size_t pos, std::size_t& probes) const;
+
+  std::optional<record> find(const record& needle, std::size_t& probes) const;
+  std::optional<record> search_eytzinger(const record& needle, std::size_t& probes) const;
+  std::optional<record> search_window(const record& needle, std::size_t first, std::size_t last,
+                                      std::size_t& probes) const;
+
+  // [first, last) records which could contain needle's lower_bound, narrowed by any index
+  [[nodiscard]] std::pair<std::size_t, std::size_t> candidates(const record& needle) const;
+
+  void gallop(std::span<const record> needles, std::span<const std::size_t> order,
+              std::vector<std::optional<record>>& results) const;
+  void merge_join(std::span<const record> needles, std::span<const std::size_t> order,
+                  std::vector<std::optional<record>>& results) const;
+  void search_uring(std::span<const record> needles, std::span<const std::size_t> order,
+                    std::vector<std::optional<record>>& results) const;
+
+  std::size_t lower_bound(const record& needle, std::size_t first, std::size_t last,
+                          std::size_t& probes) const;
+  std::size_t interpolate(const record& needle, std::size_t first, std::size_t last,
+                          double lokey, double hikey, std::size_t& probes) const;
+
+  std::string                 dbfilename_;
+  std::filesystem::path       dbpath_;
+  db_options                  opts_;
+  std::size_t                 dbfsize_;
+  std::size_t                 dbsize_;
+  layout                      layout_      = layout::sorted;
+  std::size_t                 data_offset_ = 0; // sizeof(file_header) if there is one
+  std::uint32_t               generation_  = 0;
+  mutable std::ifstream       db_;
+  mutable std::mutex          db_mutex_; // guards db_
+  pread_file                  file_;
+  mmap_file                   map_;
+  const record*               records_ = nullptr; // into map_
+  std::optional<prefix_index> index_;
+  std::optional<spline_index> spline_; // strategy::learned only
+  std::optional<fuse_filter>  filter_;
+
+  mutable std::atomic<std::size_t> probes_ = 0;
+};
+
+template <std::size_t N>
+template <typename Func>
+void basic_database<N>::for_each(Func func) const {
+  if (records_ != nullptr) {
+    constexpr std::size_t window = (4U << 20U) / sizeof(record); // records read ahead at once
+    map_.prefetch(data_offset_, window * sizeof(record));
+    for (std::size_t pos = 0; pos < dbsize_; ++pos) {
+      if (pos % window == 0) // keep one window in flight beyond the current one
+        map_.prefetch(data_offset_ + (pos + window) * sizeof(record), window * sizeof(record));
+      if (!func(records_[pos])) return;
+    }
+    return;
+  }
+
+  constexpr std::size_t bufcnt = 1U << 16U;
+  std::vector<record>   buf(bufcnt);
+  auto                  lock = lock_stream();
+  if (!file_.is_open()) {
+    db_.clear();
+    db_.seekg(static_cast<long>(data_offset_));
+  }
+  for (std::size_t pos = 0; pos < dbsize_;) {
+    std::size_t cnt = std::min(bufcnt, dbsize_ - pos);
+    if (file_.is_open()) {
+      file_.read(buf.data(), cnt * sizeof(record), data_offset_ + pos * sizeof(record));
+    } else {
+      db_.read(reinterpret_cast<char*>(buf.data()), // NOLINT reincast
+               static_cast<std::streamsize>(cnt * sizeof(record)));
+      if (!db_) throw std::domain_error("failed reading db: " + dbfilename_);
+    }
+    for (std::size_t i = 0; i < cnt; ++i)
+      if (!func(buf[i])) return;
+    pos += cnt;
+  }
+}
+
+using database      = basic_database<20>;
+using ntlm_database = basic_database<16>;
+
+extern template class basic_database<20>;
+extern template class basic_database<16>;
+
+} // namespace hibp
@@ -0,0 +1,119 @@
+#include "mmap.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace hibp {
+
+mmap_file::mmap_file(const std::filesystem::path& path) {
+  map_fd(pread_file(path).native_handle(), path); // the file is closed again once mapped
+}
+
+mmap_file::mmap_file(const pread_file& file, const std::filesystem::path& path) {
+  map_fd(file.native_handle(), path);
+}
+
+void mmap_file::map_fd(int fd, const std::filesystem::path& path) {
+  struct stat st {};
+  if (::fstat(fd, &st) == -1)
+    throw std::domain_error("cannot stat `" + path.string() + "`: " + std::strerror(errno));
+  size_ = static_cast<std::size_t>(st.st_size);
+
+  if (size_ > 0) { // mmap refuses zero length mappings
+    void* map = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) // NOLINT int to ptr cast in macro
+      throw std::domain_error("cannot mmap `" + path.string() + "`: " + std::strerror(errno));
+    map_ = static_cast<std::byte*>(map);
+  }
+}
+
+mmap_file::~mmap_file() {
+  if (map_ == nullptr) return;
+  if (locked_) ::munlock(map_, size_);
+  ::munmap(map_, size_);
+}
+
+void mmap_file::advise(int advice) const {
+  if (map_ == nullptr) return;
+  if (::madvise(map_, size_, advice) != 0)
+    throw std::domain_error(std::string("madvise failed: ") + std::strerror(errno));
+}
+
+void mmap_file::prefetch(std::size_t offset, std::size_t size) const {
+  if (map_ == nullptr || offset >= size_) return;
+  static const auto page  = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  std::size_t       first = offset / page * page;
+  std::size_t       last  = std::min(size_, offset + size);
+  if (::madvise(map_ + first, last - first, MADV_WILLNEED) != 0)
+    throw std::domain_error(std::string("madvise failed: ") + std::strerror(errno));
+}
+
+void mmap_file::lock() {
+  if (map_ == nullptr || locked_) return;
+  advise(MADV_WILLNEED); // kick off async read-ahead, mlock then mostly finds pages resident
+  if (::mlock(map_, size_) != 0)
+    throw std::domain_error(std::string("mlock failed (check `ulimit -l`): ") +
+                            std::strerror(errno));
+  locked_ = true;
+}
+
+void mmap_file::swap(mmap_file& other) noexcept {
+  std::swap(map_, other.map_);
+  std::swap(size_, other.size_);
+  std::swap(locked_, other.locked_);
+}
+
+pread_file::pread_file(const std::filesystem::path& path)
+    : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) { // NOLINT vararg
+  if (fd_ == -1)
+    throw std::domain_error("cannot open `" + path.string() + "`: " + std::strerror(errno));
+}
+
+pread_file::~pread_file() {
+  if (fd_ != -1) ::close(fd_);
+}
+
+std::size_t pread_file::size() const {
+  struct stat st {};
+  if (::fstat(fd_, &st) == -1)
+    throw std::domain_error(std::string("fstat failed: ") + std::strerror(errno));
+  return static_cast<std::size_t>(st.st_size);
+}
+
+void pread_file::read(void* buf, std::size_t size, std::size_t offset) const {
+  auto* p = static_cast<char*>(buf);
+  while (size > 0) {
+    ssize_t got = ::pread(fd_, p, size, static_cast<off_t>(offset));
+    if (got == -1 && errno == EINTR) continue;
+    if (got == -1) throw std::domain_error(std::string("pread failed: ") + std::strerror(errno));
+    if (got == 0) throw std::domain_error("pread: unexpected end of file");
+    p += got;
+    size -= static_cast<std::size_t>(got);
+    offset += static_cast<std::size_t>(got);
+  }
+}
+
+void pread_file::advise(int advice) const {
+  int ret = ::posix_fadvise(fd_, 0, 0, advice); // returns the error, not in errno
+  if (ret != 0)
+    throw std::domain_error(std::string("posix_fadvise failed: ") + std::strerror(ret));
+}
+
+void evict_page_cache(const std::filesystem::path& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC); // NOLINT vararg
+  if (fd == -1)
+    throw std::domain_error("cannot open `" + path.string() + "`: " + std::strerror(errno));
+  int ret = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED); // returns the error, not in errno
+  ::close(fd);
+  if (ret != 0)
+    throw std::domain_error(std::string("posix_fadvise failed: ") + std::strerror(ret));
+}
+
+} // namespace hibp
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <utility>
+
+namespace hibp {
+
+class pread_file;
+
+// read-only memory mapping of an entire file. RAII wrapper for mmap/munmap.
+class mmap_file {
+public:
+  mmap_file() = default;
+  explicit mmap_file(const std::filesystem::path& path);
+  // map the file already open as `file`, which was opened from path
+  mmap_file(const pread_file& file, const std::filesystem::path& path);
+
+  mmap_file(const mmap_file& m) = delete;
+  mmap_file& operator=(const mmap_file& other) = delete;
+
+  mmap_file(mmap_file&& other) noexcept { swap(other); }
+  mmap_file& operator=(mmap_file&& other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~mmap_file();
+
+  [[nodiscard]] const std::byte* data() const { return map_; }
+  [[nodiscard]] std::size_t      size() const { return size_; }
+  [[nodiscard]] bool             empty() const { return size_ == 0; }
+
+  // hint the expected access pattern to the kernel. advice is one of MADV_*
+  void advise(int advice) const;
+
+  // start async read-ahead of [offset, offset + size), widened to whole pages and clamped to the
+  // file. Unlike advise() it leaves the mapping's access pattern alone, so is safe to call from
+  // many threads reading one mapping.
+  void prefetch(std::size_t offset, std::size_t size) const;
+
+  // fault the whole file in and pin it in RAM. Subject to RLIMIT_MEMLOCK.
+  void lock();
+
+private:
+  void map_fd(int fd, const std::filesystem::path& path);
+  void swap(mmap_file& other) noexcept;
+
+  std::byte*  map_    = nullptr;
+  std::size_t size_   = 0;
+  bool        locked_ = false;
+};
+
+// read-only file descriptor for positioned reads. Unlike a std::ifstream there is no file
+// position, so one instance can serve many threads at once. RAII wrapper for open/close.
+class pread_file {
+public:
+  pread_file() = default;
+  explicit pread_file(const std::filesystem::path& path);
+
+  pread_file(const pread_file& m) = delete;
+  pread_file& operator=(const pread_file& other) = delete;
+
+  pread_file(pread_file&& other) noexcept { std::swap(fd_, other.fd_); }
+  pread_file& operator=(pread_file&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    return *this;
+  }
+
+  ~pread_file();
+
+  [[nodiscard]] bool is_open() const { return fd_ != -1; }
+  [[nodiscard]] int  native_handle() const { return fd_; }
+
+  // of the file as opened, even once another has been renamed over its path
+  [[nodiscard]] std::size_t size() const;
+
+  // exactly size bytes at offset into buf, throws on errors and short reads
+  void read(void* buf, std::size_t size, std::size_t offset) const;
+
+  // hint the expected access pattern to the kernel. advice is one of POSIX_FADV_*
+  void advise(int advice) const;
+
+private:
+  int fd_ = -1;
+};
+
+// ask the kernel to drop the file's clean pages from the page cache, for cold cache benchmarks
+void evict_page_cache(const std::filesystem::path& path);
+
+} // namespace hibp
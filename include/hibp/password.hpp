@@ -0,0 +1,127 @@
+#pragma once
+
+#include "hibp/hex.hpp"
+#include "os/str.hpp"
+#include <array>
+#include <bit>
+#include <cassert>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace hibp {
+
+// unsigned because the next ops are likely bit-wise
+inline unsigned make_nibble(char nibblechr) {
+  int nibble = nibblechr - '0';
+  if (nibble > 9) nibble = (nibble & ~('a' - 'A')) - ('A' - '0') + 10; // NOLINT
+  assert(nibble >= 0 and nibble <= 15);                                // NOLINT decay
+  return static_cast<unsigned>(nibble);
+}
+
+// hash algorithm of the records in a .bin, recorded in its file_header
+enum class hash_type : std::uint32_t {
+  sha1 = 0, // 20 bytes, the Pwned Passwords default. Headerless files are always sha1
+  ntlm = 1  // 16 bytes, MD4 of the UTF-16LE password, as exported from Active Directory
+};
+
+constexpr std::size_t hash_width(hash_type type) { return type == hash_type::ntlm ? 16 : 20; }
+
+constexpr const char* hash_name(hash_type type) {
+  return type == hash_type::ntlm ? "ntlm" : "sha1";
+}
+
+// big-endian unsigned integer at p, so integer order is byte order. T is uint32_t or uint64_t
+template <typename T>
+T load_be(const std::byte* p) {
+  T v; // NOLINT initialization
+  std::memcpy(&v, p, sizeof(v));
+  if constexpr (std::endian::native == std::endian::little) {
+    if constexpr (sizeof(T) == 8)
+      v = __builtin_bswap64(v);
+    else
+      v = __builtin_bswap32(v);
+  }
+  return v;
+}
+
+// One record of a .bin: a hash of N bytes and its count. Compiled separately for each width, so
+// the layout is fixed and comparisons are a few integer loads rather than a byte loop.
+template <std::size_t N>
+struct basic_password {
+  static_assert(N == 20 || N == 16, "hash width must be 20 (sha1) or 16 (ntlm)");
+  static constexpr hash_type type = N == 16 ? hash_type::ntlm : hash_type::sha1;
+
+  basic_password() = default;
+
+  // offset is the size of the file_header, if any
+  basic_password(std::ifstream& db, std::size_t pos, std::size_t offset = 0) { // NOLINT init
+    db.seekg(static_cast<long>(offset + pos * sizeof(basic_password)));
+    db.read(reinterpret_cast<char*>(this), sizeof(*this)); // NOLINT reinterpret_cast
+  }
+
+  // line must be an upppercase hex hash of N bytes with optional ":123" appended (123 is the
+  // count).
+  explicit basic_password(std::string_view line) { // NOLINT initlialisation
+    assert(line.length() >= hash.size() * 2);      // NOLINT decay
+    hex_decode(line.data(), hash.data(), N);
+
+    if (line.size() > hash.size() * 2 + 1)
+      count = os::str::parse_nonnegative_int(line.data() + hash.size() * 2 + 1,
+                                             line.data() + line.size(), -1);
+    else
+      count = -1;
+  }
+
+  bool operator==(const basic_password& rhs) const {
+    return std::memcmp(hash.data(), rhs.hash.data(), N) == 0;
+  }
+
+  // big-endian words: two 64 bit loads for ntlm, plus a 32 bit one for sha1
+  std::strong_ordering operator<=>(const basic_password& rhs) const {
+    if (auto c = prefix() <=> rhs.prefix(); c != 0) return c;
+    if constexpr (N == 16) {
+      return load_be<std::uint64_t>(hash.data() + 8) <=>
+             load_be<std::uint64_t>(rhs.hash.data() + 8);
+    } else {
+      if (auto c = load_be<std::uint64_t>(hash.data() + 8) <=>
+                   load_be<std::uint64_t>(rhs.hash.data() + 8);
+          c != 0)
+        return c;
+      return load_be<std::uint32_t>(hash.data() + 16) <=>
+             load_be<std::uint32_t>(rhs.hash.data() + 16);
+    }
+  }
+
+  // first 8 bytes of the hash as a big-endian integer: ordered like hash and uniformly distributed
+  [[nodiscard]] std::uint64_t prefix() const { return load_be<std::uint64_t>(hash.data()); }
+
+  friend std::ostream& operator<<(std::ostream& os, const basic_password& rhs) {
+    std::array<char, 2 * N> hex; // NOLINT initialization
+    hex_encode(rhs.hash.data(), hex.data(), N);
+    os.write(hex.data(), hex.size());
+    os << ":" << rhs.count;
+    return os;
+  }
+
+  std::array<std::byte, N> hash;
+  int32_t                  count; // be definitive about size
+};
+
+using password      = basic_password<20>;
+using ntlm_password = basic_password<16>;
+
+static_assert(sizeof(password) == 24 && sizeof(ntlm_password) == 20, "records must be packed");
+
+// size of one record in a .bin of hashes of type
+constexpr std::size_t record_size(hash_type type) {
+  return type == hash_type::ntlm ? sizeof(ntlm_password) : sizeof(password);
+}
+
+} // namespace hibp
@@ -0,0 +1,109 @@
+#include "prefix_index.hpp"
+#include "header.hpp"
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace hibp {
+
+namespace {
+
+struct index_header {
+  std::array<char, 8> magic;
+  std::uint32_t       bits;
+  std::uint32_t       generation; // was reserved, so 0 in older files, as in their .bin
+  std::uint64_t       records;
+};
+
+constexpr std::array<char, 8> index_magic = {'H', 'I', 'B', 'P', 'I', 'D', 'X', '1'};
+
+} // namespace
+
+prefix_index::prefix_index(unsigned bits) : bits_(bits) {
+  if (bits_ == 0 || bits_ > max_bits)
+    throw std::domain_error("prefix_index bits must be in 1.." + std::to_string(max_bits));
+  offsets_.resize((std::size_t{1} << bits_) + 1);
+}
+
+prefix_index::prefix_index(const std::filesystem::path& path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is.is_open()) throw std::domain_error("cannot open index: " + path.string());
+
+  index_header hdr{};
+  is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  if (!is || hdr.magic != index_magic || hdr.bits == 0 || hdr.bits > max_bits)
+    throw std::domain_error("not a valid hibp index file: " + path.string());
+
+  bits_       = hdr.bits;
+  records_    = hdr.records;
+  generation_ = hdr.generation;
+  offsets_.resize((std::size_t{1} << bits_) + 1);
+  is.read(reinterpret_cast<char*>(offsets_.data()), // NOLINT reincast
+          static_cast<std::streamsize>(offsets_.size() * sizeof(offsets_[0])));
+  if (!is || offsets_.back() != records_)
+    throw std::domain_error("truncated hibp index file: " + path.string());
+}
+
+void prefix_index::fill_to(std::size_t bucket) {
+  for (; next_bucket_ < bucket; ++next_bucket_) offsets_[next_bucket_ + 1] = records_;
+}
+
+void prefix_index::add_to(std::size_t b) {
+  if (b + 1 < next_bucket_) throw std::domain_error("prefix_index: input is not sorted by hash");
+  fill_to(b + 1);
+  ++records_;
+  offsets_[b + 1] = records_; // provisional: bucket may still grow
+}
+
+void prefix_index::save(const std::filesystem::path& path, std::uint32_t generation) {
+  fill_to(offsets_.size() - 1);
+
+  std::ofstream os(path, std::ios::binary);
+  if (!os.is_open()) throw std::domain_error("cannot open index for writing: " + path.string());
+
+  index_header hdr{
+      .magic = index_magic, .bits = bits_, .generation = generation, .records = records_};
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  os.write(reinterpret_cast<const char*>(offsets_.data()),    // NOLINT reincast
+           static_cast<std::streamsize>(offsets_.size() * sizeof(offsets_[0])));
+  if (!os) throw std::domain_error("failed writing index: " + path.string());
+}
+
+namespace {
+
+// large sequential reads, this is a single streaming pass over a multi-GB file
+template <std::size_t N>
+void add_all(std::ifstream& is, prefix_index& idx) {
+  constexpr std::size_t          bufcnt = 1U << 16U;
+  std::vector<basic_password<N>> buf(bufcnt);
+  while (is) {
+    is.read(reinterpret_cast<char*>(buf.data()), // NOLINT reincast
+            static_cast<std::streamsize>(buf.size() * sizeof(basic_password<N>)));
+    auto got = static_cast<std::size_t>(is.gcount()) / sizeof(basic_password<N>);
+    std::for_each(buf.begin(), buf.begin() + static_cast<long>(got),
+                  [&](const basic_password<N>& pw) { idx.add(pw); });
+  }
+}
+
+} // namespace
+
+void build_index(const std::filesystem::path& dbpath, unsigned bits) {
+  auto hdr = read_header(dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("a prefix index requires a sorted db: " + dbpath.string());
+
+  std::ifstream is(dbpath, std::ios::binary);
+  if (!is.is_open()) throw std::domain_error("cannot open db: " + dbpath.string());
+  if (hdr) is.seekg(sizeof(file_header));
+
+  prefix_index idx(bits);
+  if (hdr && hdr->type == hash_type::ntlm)
+    add_all<16>(is, idx);
+  else
+    add_all<20>(is, idx);
+  idx.save(prefix_index::sidecar_path(dbpath), hdr ? hdr->generation : 0);
+}
+
+} // namespace hibp
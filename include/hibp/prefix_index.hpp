@@ -0,0 +1,70 @@
+#pragma once
+
+#include "hibp/password.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+// Maps the leading `bits` of the hash to the range of records sharing that prefix. Because sha1
+// is uniform, each bucket holds ~records/2^bits entries, so a search only needs to bisect
+// within a few hundred records. Stored as a sidecar file next to the .bin (see sidecar_path()).
+class prefix_index {
+public:
+  static constexpr unsigned default_bits = 20; // 1M buckets, 8MB
+  static constexpr unsigned max_bits     = 24; // bucket() only looks at the first 3 bytes
+
+  // an empty index, ready for add()
+  explicit prefix_index(unsigned bits = default_bits);
+
+  // load a previously save()'d index
+  explicit prefix_index(const std::filesystem::path& path);
+
+  // passwords must be added in sorted order, one call per record in the .bin
+  template <std::size_t N>
+  void add(const basic_password<N>& pw) {
+    add_to(bucket(pw));
+  }
+  // stamped with the file_header::generation of the .bin it indexes
+  void save(const std::filesystem::path& path, std::uint32_t generation = 0);
+
+  // [first, last) record positions which could contain needle
+  template <std::size_t N>
+  [[nodiscard]] std::pair<std::size_t, std::size_t> range(const basic_password<N>& needle) const {
+    auto b = bucket(needle);
+    return {offsets_[b], offsets_[b + 1]};
+  }
+
+  [[nodiscard]] unsigned    bits() const { return bits_; }
+  [[nodiscard]] std::size_t   records() const { return records_; }
+  [[nodiscard]] std::uint32_t generation() const { return generation_; }
+
+  template <std::size_t N>
+  [[nodiscard]] std::size_t bucket(const basic_password<N>& pw) const {
+    auto prefix = static_cast<unsigned>(pw.hash[0]) << 16U |
+                  static_cast<unsigned>(pw.hash[1]) << 8U | static_cast<unsigned>(pw.hash[2]);
+    return prefix >> (max_bits - bits_);
+  }
+
+  static std::filesystem::path sidecar_path(const std::filesystem::path& dbpath) {
+    return dbpath.string() + ".idx";
+  }
+
+private:
+  void fill_to(std::size_t bucket); // close all buckets < bucket at records_
+  void add_to(std::size_t bucket);
+
+  unsigned                   bits_;
+  std::vector<std::uint64_t> offsets_; // 2^bits + 1 entries, bucket b is [b, b+1)
+  std::size_t                records_     = 0;
+  std::uint32_t              generation_  = 0; // loaded only, see save()
+  std::size_t                next_bucket_ = 0; // build only: first bucket not yet opened
+};
+
+// (re)generate the sidecar index for an existing .bin file in one sequential pass
+void build_index(const std::filesystem::path& dbpath, unsigned bits = prefix_index::default_bits);
+
+} // namespace hibp
@@ -0,0 +1,374 @@
+#include "range_server.hpp"
+#include "header.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace hibp {
+
+namespace {
+
+constexpr unsigned    prefix_bits = 20;   // 5 hex digits
+constexpr std::size_t max_request = 8192; // bytes of an incomplete request before we give up
+constexpr int         max_events  = 64;
+
+[[noreturn]] void throw_errno(const std::string& what) {
+  throw std::domain_error(what + ": " + std::strerror(errno));
+}
+
+std::optional<std::uint32_t> parse_prefix(std::string_view hex) {
+  if (hex.size() != prefix_bits / 4) return std::nullopt;
+  std::uint32_t prefix = 0;
+  for (char c: hex) {
+    if (std::isxdigit(static_cast<unsigned char>(c)) == 0) return std::nullopt;
+    prefix = prefix << 4U | make_nibble(c);
+  }
+  return prefix;
+}
+
+// "SUFFIX:COUNT\r\n", where SUFFIX omits the 5 hex digits of the prefix. Unknown counts are 0.
+void append_text(std::string& body, const password& pw) {
+  constexpr std::string_view hexdigits = "0123456789ABCDEF";
+
+  std::array<char, 40 - prefix_bits / 4 + 14> line{}; // + ":" + int32 + "\r\n"
+  char*                                        p = line.data();
+  for (unsigned n = prefix_bits / 4; n < 40; ++n) {
+    auto byte = static_cast<unsigned>(pw.hash[n / 2]);
+    *p++      = hexdigits[n % 2 == 0 ? byte >> 4U : byte & 0xFU];
+  }
+  *p++ = ':';
+  p    = std::to_chars(p, line.data() + line.size(), std::max(pw.count, 0)).ptr;
+  *p++ = '\r';
+  *p++ = '\n';
+  body.append(line.data(), p);
+}
+
+// a response: head from memory, then file_remaining bytes of the .bin with sendfile()
+struct segment {
+  std::string head;
+  std::size_t head_sent      = 0;
+  off_t       file_offset    = 0;
+  std::size_t file_remaining = 0;
+};
+
+bool contains_nocase(std::string_view haystack, std::string_view lower_needle) {
+  return std::search(haystack.begin(), haystack.end(), lower_needle.begin(), lower_needle.end(),
+                     [](char a, char b) {
+                       return std::tolower(static_cast<unsigned char>(a)) == b;
+                     }) != haystack.end();
+}
+
+} // namespace
+
+unique_fd::~unique_fd() {
+  if (fd_ != -1) ::close(fd_);
+}
+
+struct range_server::connection {
+  unique_fd           fd;
+  std::string         in;
+  std::deque<segment> out;
+  bool                close_after = false; // once out is drained
+};
+
+range_server::range_server(const std::filesystem::path& dbpath, server_options opts)
+    : opts_(std::move(opts)), file_(dbpath) {
+
+  // header, mapping and sendfile() all use the one open file, whatever is renamed over dbpath
+  map_     = mmap_file(file_, dbpath);
+  auto hdr = read_header(file_, dbpath);
+  require_hash_type(hdr, hash_type::sha1, dbpath); // the protocol is sha1 prefixes
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("range queries require a sorted db: " + dbpath.string());
+  data_offset_ = hdr ? sizeof(file_header) : 0;
+  if (map_.size() < data_offset_ || (map_.size() - data_offset_) % sizeof(password) != 0)
+    throw std::domain_error("db file size is not a multiple of the record size");
+  records_ = {reinterpret_cast<const password*>(map_.data() + data_offset_), // NOLINT reincast
+              (map_.size() - data_offset_) / sizeof(password)};
+  map_.advise(MADV_RANDOM);
+
+  if (auto idxpath = prefix_index::sidecar_path(dbpath); std::filesystem::exists(idxpath)) {
+    index_.emplace(idxpath);
+    if (index_->records() != records_.size() ||
+        index_->generation() != (hdr ? hdr->generation : 0))
+      throw std::domain_error("stale index: " + idxpath.string() + " does not match " +
+                              dbpath.string() + ". Rebuild it with `hibp index`");
+  }
+
+  stop_fd_ = unique_fd(::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (stop_fd_.get() == -1) throw_errno("eventfd");
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port   = htons(opts_.port);
+  if (::inet_pton(AF_INET, opts_.address.c_str(), &addr.sin_addr) != 1)
+    throw std::domain_error("not an IPv4 address: " + opts_.address);
+
+  // one listener per loop, the kernel spreads connections between them
+  for (unsigned i = 0; i < std::max(1U, opts_.threads); ++i) {
+    auto& fd = listen_fds_.emplace_back(
+        ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+    if (fd.get() == -1) throw_errno("socket");
+    int on = 1;
+    ::setsockopt(fd.get(), SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::setsockopt(fd.get(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1)
+      throw_errno("SO_REUSEPORT");
+    // NOLINTNEXTLINE reincast
+    if (::bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == -1)
+      throw_errno("cannot bind " + opts_.address + ":" + std::to_string(ntohs(addr.sin_port)));
+    if (::listen(fd.get(), SOMAXCONN) == -1) throw_errno("listen");
+
+    if (addr.sin_port == 0) { // the others must share the port the kernel picked
+      socklen_t len = sizeof(addr);
+      ::getsockname(fd.get(), reinterpret_cast<sockaddr*>(&addr), &len); // NOLINT reincast
+    }
+  }
+  port_ = ntohs(addr.sin_port);
+}
+
+std::pair<std::size_t, std::size_t> range_server::range(std::uint32_t prefix) const {
+  // the lowest and highest hashes with this prefix
+  password lo{};
+  password hi{};
+  lo.hash.fill(std::byte{0x00});
+  hi.hash.fill(std::byte{0xFF});
+  lo.hash[0] = hi.hash[0] = static_cast<std::byte>(prefix >> 12U);
+  lo.hash[1] = hi.hash[1] = static_cast<std::byte>(prefix >> 4U);
+  lo.hash[2]              = static_cast<std::byte>((prefix & 0xFU) << 4U);
+  hi.hash[2]              = static_cast<std::byte>((prefix & 0xFU) << 4U | 0xFU);
+
+  if (index_ && index_->bits() == prefix_bits) return index_->range(lo); // exactly one bucket
+
+  std::size_t first = 0;
+  std::size_t last  = records_.size();
+  if (index_) { // narrow to the bucket(s) covering the range, then bisect within
+    first = index_->range(lo).first;
+    last  = index_->range(hi).second;
+  }
+  auto b = std::lower_bound(records_.begin() + static_cast<long>(first),
+                            records_.begin() + static_cast<long>(last), lo);
+  auto e = std::upper_bound(b, records_.begin() + static_cast<long>(last), hi);
+  return {static_cast<std::size_t>(b - records_.begin()),
+          static_cast<std::size_t>(e - records_.begin())};
+}
+
+void range_server::respond(std::string_view request, connection& conn) const {
+  auto reply = [&](std::string_view status, std::string_view type, std::size_t length,
+                   bool close) -> segment& {
+    segment& seg = conn.out.emplace_back();
+    seg.head     = "HTTP/1.1 ";
+    seg.head += status;
+    seg.head += "\r\nContent-Type: ";
+    seg.head += type;
+    seg.head += "\r\nContent-Length: " + std::to_string(length) + "\r\n";
+    if (close) {
+      seg.head += "Connection: close\r\n";
+      conn.close_after = true;
+    }
+    seg.head += "\r\n";
+    return seg;
+  };
+  auto error = [&](std::string_view status) {
+    segment& seg = reply(status, "text/plain", status.size() + 1, true);
+    seg.head += status;
+    seg.head += '\n';
+  };
+
+  // "GET /range/ABCDE HTTP/1.1"
+  std::string_view line = request.substr(0, request.find("\r\n"));
+  auto             sp1  = line.find(' ');
+  auto             sp2  = line.rfind(' ');
+  if (sp1 == std::string_view::npos || sp2 == sp1) return error("400 Bad Request");
+  std::string_view method  = line.substr(0, sp1);
+  std::string_view target  = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  std::string_view version = line.substr(sp2 + 1);
+  bool close = version != "HTTP/1.1" || contains_nocase(request, "\r\nconnection: close");
+
+  if (method != "GET") return error("405 Method Not Allowed");
+  if (!target.starts_with("/range/")) return error("404 Not Found");
+  target.remove_prefix(std::string_view("/range/").size());
+  bool binary = target.ends_with(".bin");
+  if (binary) target.remove_suffix(std::string_view(".bin").size());
+  auto prefix = parse_prefix(target);
+  if (!prefix) return error("400 Bad Request");
+
+  auto [first, last] = range(*prefix);
+  if (binary) {
+    segment& seg      = reply("200 OK", "application/octet-stream",
+                              (last - first) * sizeof(password), close);
+    seg.file_offset    = static_cast<off_t>(data_offset_ + first * sizeof(password));
+    seg.file_remaining = (last - first) * sizeof(password);
+  } else {
+    std::string body;
+    body.reserve((last - first) * 48);
+    for (std::size_t pos = first; pos < last; ++pos) append_text(body, records_[pos]);
+    segment& seg = reply("200 OK", "text/plain", body.size(), close);
+    seg.head += body;
+  }
+}
+
+// read all available bytes and queue responses for all complete requests. false: drop the client
+bool range_server::on_readable(int fd, connection& conn) const {
+  std::array<char, 4096> buf; // NOLINT initialization
+  while (true) {
+    ssize_t got = ::read(fd, buf.data(), buf.size());
+    if (got > 0) {
+      conn.in.append(buf.data(), static_cast<std::size_t>(got));
+    } else if (got == 0) { // peer shut down its side, answer what we have, then close
+      conn.close_after = true;
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break;
+    } else {
+      return false;
+    }
+  }
+
+  bool peer_closed = conn.close_after;
+  conn.close_after = false;
+  std::size_t end  = 0;
+  while (!conn.close_after && (end = conn.in.find("\r\n\r\n")) != std::string::npos) {
+    respond(std::string_view(conn.in).substr(0, end + 4), conn); // pipelined requests in order
+    conn.in.erase(0, end + 4);
+  }
+  if (conn.in.size() > max_request) {
+    segment& seg = conn.out.emplace_back();
+    seg.head     = "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\n"
+                   "Connection: close\r\n\r\n";
+    conn.close_after = true;
+    conn.in.clear();
+  }
+  conn.close_after = conn.close_after || peer_closed;
+  return true;
+}
+
+// send as much as the socket takes. false: done with, or drop, the client
+bool range_server::on_writable(int fd, connection& conn) const {
+  while (!conn.out.empty()) {
+    segment& seg = conn.out.front();
+    ssize_t  sent = 0;
+    if (seg.head_sent < seg.head.size()) {
+      sent = ::send(fd, seg.head.data() + seg.head_sent, seg.head.size() - seg.head_sent,
+                    MSG_NOSIGNAL);
+      if (sent > 0) seg.head_sent += static_cast<std::size_t>(sent);
+    } else if (seg.file_remaining > 0) { // zero copy, page cache to socket
+      sent = ::sendfile(fd, file_.native_handle(), &seg.file_offset, seg.file_remaining);
+      if (sent == 0) return false; // file shrunk under us
+      if (sent > 0) seg.file_remaining -= static_cast<std::size_t>(sent);
+    } else {
+      conn.out.pop_front();
+      continue;
+    }
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK; // wait for EPOLLOUT
+    }
+  }
+  return !conn.close_after;
+}
+
+void range_server::serve(int listen_fd) const {
+  unique_fd ep(::epoll_create1(EPOLL_CLOEXEC));
+  if (ep.get() == -1) throw_errno("epoll_create1");
+
+  auto watch = [&](int fd, std::uint32_t events) {
+    epoll_event ev{};
+    ev.events  = events;
+    ev.data.fd = fd;
+    if (::epoll_ctl(ep.get(), EPOLL_CTL_ADD, fd, &ev) == -1) throw_errno("epoll_ctl");
+  };
+  watch(listen_fd, EPOLLIN);
+  watch(stop_fd_.get(), EPOLLIN);
+
+  std::unordered_map<int, connection>    conns; // erasing closes the socket
+  std::array<epoll_event, max_events>    events{};
+  while (true) {
+    int n = ::epoll_wait(ep.get(), events.data(), max_events, -1);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      throw_errno("epoll_wait");
+    }
+    for (auto& ev: std::span(events).first(static_cast<std::size_t>(n))) {
+      int fd = ev.data.fd;
+      if (fd == stop_fd_.get()) return; // left readable, so every loop sees it
+
+      if (fd == listen_fd) {
+        int cfd = 0;
+        while ((cfd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+          int on = 1; // responses are written whole, don't hold back their last segment
+          ::setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+          conns[cfd].fd = unique_fd(cfd);
+          watch(cfd, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        }
+        continue; // EAGAIN, or out of fds: try again on the next event
+      }
+
+      auto it = conns.find(fd);
+      if (it == conns.end()) continue;
+      bool keep = true;
+      if ((ev.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0)
+        keep = on_readable(fd, it->second);
+      if (keep) keep = on_writable(fd, it->second);
+      if (!keep) conns.erase(it); // closing also removes it from the epoll set
+    }
+  }
+}
+
+void range_server::run() {
+  std::signal(SIGPIPE, SIG_IGN); // a client leaving during sendfile() must not kill the server
+
+  auto loop = [this](int fd) {
+    try {
+      serve(fd);
+    } catch (...) {
+      stop(); // take the other loops down too
+      throw;
+    }
+  };
+
+  std::vector<std::future<void>> others;
+  for (std::size_t i = 1; i < listen_fds_.size(); ++i)
+    others.push_back(std::async(std::launch::async, loop, listen_fds_[i].get()));
+
+  std::exception_ptr err;
+  try {
+    loop(listen_fds_[0].get());
+  } catch (...) {
+    err = std::current_exception();
+  }
+  for (auto& f: others) {
+    try {
+      f.get();
+    } catch (...) {
+      if (!err) err = std::current_exception();
+    }
+  }
+  if (err) std::rethrow_exception(err);
+}
+
+void range_server::stop() const {
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto ret = ::write(stop_fd_.get(), &one, sizeof(one)); // only fails if done
+}
+
+} // namespace hibp
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "hibp/mmap.hpp"
+#include "hibp/password.hpp"
+#include "hibp/prefix_index.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+// owns a file descriptor
+class unique_fd {
+public:
+  unique_fd() = default;
+  explicit unique_fd(int fd) : fd_(fd) {}
+
+  unique_fd(const unique_fd& m) = delete;
+  unique_fd& operator=(const unique_fd& other) = delete;
+
+  unique_fd(unique_fd&& other) noexcept { std::swap(fd_, other.fd_); }
+  unique_fd& operator=(unique_fd&& other) noexcept {
+    std::swap(fd_, other.fd_);
+    return *this;
+  }
+
+  ~unique_fd();
+
+  [[nodiscard]] int get() const { return fd_; }
+
+private:
+  int fd_ = -1;
+};
+
+struct server_options {
+  std::string   address = "127.0.0.1"; // loopback only, unless told otherwise
+  std::uint16_t port    = 8080;        // 0 = any free port, see range_server::port()
+  unsigned      threads = 1;           // event loops, each with its own SO_REUSEPORT listener
+};
+
+// HTTP server for the k-anonymity range protocol of the Pwned Passwords API, over a sorted .bin:
+//
+//   GET /range/ABCDE      text/plain, one "SUFFIX:COUNT\r\n" per hash starting with ABCDE, where
+//                         SUFFIX is the remaining 35 hex digits
+//   GET /range/ABCDE.bin  application/octet-stream, the raw 24 byte records, sent with sendfile()
+//
+// With a prefix index sidecar each range is found without touching the .bin. Keep-alive and
+// pipelined requests are supported, one epoll loop per thread.
+class range_server {
+public:
+  explicit range_server(const std::filesystem::path& dbpath, server_options opts = {});
+
+  range_server(const range_server& m) = delete;
+  range_server& operator=(const range_server& other) = delete;
+
+  range_server(range_server&& other) noexcept = delete;
+  range_server& operator=(range_server&& other) noexcept = delete;
+
+  ~range_server() = default;
+
+  // serve until stop() is called
+  void run();
+
+  // make run() return. Safe to call from any thread or a signal handler.
+  void stop() const;
+
+  // the bound port, useful with opts.port = 0
+  [[nodiscard]] std::uint16_t port() const { return port_; }
+
+  // [first, last) record positions of the hashes whose first 20 bits are prefix
+  [[nodiscard]] std::pair<std::size_t, std::size_t> range(std::uint32_t prefix) const;
+
+private:
+  struct connection;
+
+  void serve(int listen_fd) const;
+  bool on_readable(int fd, connection& conn) const;
+  bool on_writable(int fd, connection& conn) const;
+  void respond(std::string_view request, connection& conn) const;
+
+  server_options              opts_;
+  mmap_file                   map_;
+  pread_file                  file_; // for sendfile()
+  std::size_t                 data_offset_ = 0;
+  std::span<const password>   records_;
+  std::optional<prefix_index> index_;
+  std::vector<unique_fd>      listen_fds_;
+  unique_fd                   stop_fd_; // eventfd, readable once stop() was called
+  std::uint16_t               port_ = 0;
+};
+
+} // namespace hibp
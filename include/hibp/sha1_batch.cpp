@@ -0,0 +1,295 @@
+#include "sha1_batch.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace hibp {
+
+namespace {
+
+using u32    = std::uint32_t;
+using digest = std::array<std::byte, 20>;
+using block  = std::array<unsigned char, 64>;
+
+// gcc/clang vector extensions: element-wise operators, compiled for the enclosing function's
+// target, so one generic kernel serves every lane count
+using u32x4  = u32 __attribute__((vector_size(16)));
+using u32x8  = u32 __attribute__((vector_size(32)));
+using u32x16 = u32 __attribute__((vector_size(64)));
+
+constexpr std::array<u32, 5> iv = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+constexpr std::array<u32, 4> k  = {0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6};
+
+std::size_t block_count(std::size_t len) { return (len + 8) / 64 + 1; }
+
+// block b of msg, with the 0x80, zeros and big-endian bit length padding applied
+void padded_block(std::string_view msg, std::size_t b, block& blk) {
+  std::size_t off = b * 64;
+  blk.fill(0);
+  if (off < msg.size())
+    std::memcpy(blk.data(), msg.data() + off, std::min<std::size_t>(64, msg.size() - off));
+  if (msg.size() >= off && msg.size() - off < 64) blk[msg.size() - off] = 0x80;
+  if (b + 1 == block_count(msg.size())) {
+    std::uint64_t bits = std::uint64_t{msg.size()} * 8;
+    for (unsigned i = 0; i < 8; ++i) blk[63 - i] = static_cast<unsigned char>(bits >> (8U * i));
+  }
+}
+
+u32 load_be32(const unsigned char* p) {
+  return u32{p[0]} << 24U | u32{p[1]} << 16U | u32{p[2]} << 8U | u32{p[3]};
+}
+
+void store_be32(std::byte* p, u32 v) {
+  for (unsigned i = 0; i < 4; ++i) p[i] = static_cast<std::byte>(v >> (24U - 8U * i));
+}
+
+// The kernels below are templated on T = u32 (one message) or a vector of u32 (one message per
+// lane). They are always inlined, so that they are compiled for the target of their caller, and
+// the vector ABI of their signatures never matters.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi" // reported at the end of the TU, so not push/pop
+#endif
+
+template <typename T>
+[[gnu::always_inline]] inline T rol(const T& x, unsigned n) {
+  return (x << n) | (x >> (32U - n));
+}
+
+template <typename T>
+[[gnu::always_inline]] inline T schedule(std::array<T, 16>& w, unsigned t) {
+  if (t >= 16)
+    w[t % 16] = rol(w[(t + 13) % 16] ^ w[(t + 8) % 16] ^ w[(t + 2) % 16] ^ w[t % 16], 1U);
+  return w[t % 16];
+}
+
+template <typename T>
+[[gnu::always_inline]] inline void round(std::array<T, 5>& s, const T& f, u32 kt, const T& wt) {
+  T tmp = rol(s[0], 5U) + f + s[4] + kt + wt;
+  s[4]  = s[3];
+  s[3]  = s[2];
+  s[2]  = rol(s[1], 30U);
+  s[1]  = s[0];
+  s[0]  = tmp;
+}
+
+template <typename T>
+[[gnu::always_inline]] inline void compress(std::array<T, 5>& h, std::array<T, 16>& w) {
+  std::array<T, 5> s = h; // a, b, c, d, e
+  for (unsigned t = 0; t < 20; ++t)
+    round(s, (s[1] & s[2]) | (~s[1] & s[3]), k[0], schedule(w, t));
+  for (unsigned t = 20; t < 40; ++t) round(s, s[1] ^ s[2] ^ s[3], k[1], schedule(w, t));
+  for (unsigned t = 40; t < 60; ++t)
+    round(s, (s[1] & s[2]) | (s[3] & (s[1] | s[2])), k[2], schedule(w, t));
+  for (unsigned t = 60; t < 80; ++t) round(s, s[1] ^ s[2] ^ s[3], k[3], schedule(w, t));
+  for (std::size_t i = 0; i < 5; ++i) h[i] += s[i];
+}
+
+void hash_scalar(std::string_view msg, digest& out) {
+  std::array<u32, 5>  h = iv;
+  std::array<u32, 16> w{};
+  block               blk{};
+  for (std::size_t b = 0; b < block_count(msg.size()); ++b) {
+    padded_block(msg, b, blk);
+    for (unsigned t = 0; t < 16; ++t) w[t] = load_be32(blk.data() + 4 * t);
+    compress(h, w);
+  }
+  for (unsigned i = 0; i < 5; ++i) store_be32(out.data() + 4 * i, h[i]);
+}
+
+// messages of the same block count, one per lane
+template <std::size_t Lanes>
+using lane_msgs = std::array<std::string_view, Lanes>;
+template <std::size_t Lanes>
+using lane_outs = std::array<digest*, Lanes>;
+
+template <typename V, std::size_t Lanes>
+[[gnu::always_inline]] inline void hash_lanes(const lane_msgs<Lanes>& msgs, std::size_t nblocks,
+                                              const lane_outs<Lanes>& out) {
+  std::array<V, 5> h;
+  for (std::size_t i = 0; i < 5; ++i) h[i] = V{} + iv[i];
+  std::array<V, 16> w;
+  block             blk{};
+  for (std::size_t b = 0; b < nblocks; ++b) {
+    for (std::size_t l = 0; l < Lanes; ++l) { // transpose: word t of every lane into w[t]
+      padded_block(msgs[l], b, blk);
+      for (unsigned t = 0; t < 16; ++t) w[t][l] = load_be32(blk.data() + 4 * t);
+    }
+    compress(h, w);
+  }
+  for (std::size_t l = 0; l < Lanes; ++l)
+    for (unsigned i = 0; i < 5; ++i) store_be32(out[l]->data() + 4 * i, h[i][l]);
+}
+
+void lanes_x4(const lane_msgs<4>& msgs, std::size_t nblocks, const lane_outs<4>& out) {
+  hash_lanes<u32x4, 4>(msgs, nblocks, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+[[gnu::target("avx2")]] void lanes_x8(const lane_msgs<8>& msgs, std::size_t nblocks,
+                                      const lane_outs<8>& out) {
+  hash_lanes<u32x8, 8>(msgs, nblocks, out);
+}
+
+[[gnu::target("avx512f")]] void lanes_x16(const lane_msgs<16>& msgs, std::size_t nblocks,
+                                          const lane_outs<16>& out) {
+  hash_lanes<u32x16, 16>(msgs, nblocks, out);
+}
+
+// 4 rounds per sha1rnds4, the message schedule runs 4 words at a time in sha1msg1/sha1msg2
+[[gnu::target("sha,sse4.1")]] void hash_sha_ni(std::string_view msg, digest& out) {
+  const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+  __m128i abcd = _mm_set_epi32(static_cast<int>(iv[0]), static_cast<int>(iv[1]),
+                               static_cast<int>(iv[2]), static_cast<int>(iv[3]));
+  __m128i e0   = _mm_set_epi32(static_cast<int>(iv[4]), 0, 0, 0);
+
+  block blk{};
+  for (std::size_t b = 0; b < block_count(msg.size()); ++b) {
+    padded_block(msg, b, blk);
+    // words 4g..4g+3 of the schedule in m[g % 4]. Not std::array, it drops __m128i's attributes
+    __m128i m[4]; // NOLINT c-array
+    for (unsigned j = 0; j < 4; ++j)
+      m[j] = _mm_shuffle_epi8( // NOLINTNEXTLINE reincast
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(blk.data() + 16 * j)), bswap);
+
+    __m128i abcd_save = abcd;
+    __m128i abcd_prev = abcd;
+    __m128i e         = _mm_add_epi32(e0, m[0]);
+    for (unsigned g = 0; g < 20; ++g) {
+      if (g >= 4)
+        m[g % 4] = _mm_sha1msg2_epu32(
+            _mm_xor_si128(_mm_sha1msg1_epu32(m[g % 4], m[(g + 1) % 4]), m[(g + 2) % 4]),
+            m[(g + 3) % 4]);
+      if (g > 0) e = _mm_sha1nexte_epu32(abcd_prev, m[g % 4]);
+      abcd_prev = abcd;
+      switch (g / 5) { // the round function is an immediate
+      case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+      case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+      case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+      default: abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+      }
+    }
+    e0   = _mm_sha1nexte_epu32(abcd_prev, e0);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  std::array<u32, 4> h{};
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(h.data()), // NOLINT reincast
+                   _mm_shuffle_epi32(abcd, 0x1B));
+  for (unsigned i = 0; i < 4; ++i) store_be32(out.data() + 4 * i, h[i]);
+  store_be32(out.data() + 16, static_cast<u32>(_mm_extract_epi32(e0, 3)));
+}
+
+bool cpu_has_sha() {
+  unsigned a = 0, b = 0, c = 0, d = 0;
+  return __get_cpuid_count(7, 0, &a, &b, &c, &d) != 0 && (b & (1U << 29U)) != 0 &&
+         __builtin_cpu_supports("sse4.1");
+}
+
+#endif
+
+// Lanes share one block loop, so lanes are filled with messages of equal block count, which for
+// passwords is nearly always 1. Idle lanes in the last group of each count hash a duplicate.
+template <std::size_t Lanes>
+void hash_grouped(std::span<const std::string_view> msgs, std::span<password> out,
+                  void (*kernel)(const lane_msgs<Lanes>&, std::size_t, const lane_outs<Lanes>&)) {
+  std::vector<std::size_t> order(msgs.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return block_count(msgs[a].size()) < block_count(msgs[b].size());
+  });
+
+  digest sink{};
+  for (std::size_t g = 0; g < order.size();) {
+    std::size_t       nblocks = block_count(msgs[order[g]].size());
+    lane_msgs<Lanes>  lmsgs;
+    lane_outs<Lanes>  louts{};
+    std::size_t       l = 0;
+    for (; l < Lanes && g < order.size() && block_count(msgs[order[g]].size()) == nblocks; ++l) {
+      lmsgs[l] = msgs[order[g]];
+      louts[l] = &out[order[g]].hash;
+      ++g;
+    }
+    for (; l < Lanes; ++l) {
+      lmsgs[l] = lmsgs[0];
+      louts[l] = &sink;
+    }
+    kernel(lmsgs, nblocks, louts);
+  }
+}
+
+} // namespace
+
+bool sha1_supported(sha1_impl impl) {
+  switch (impl) {
+  case sha1_impl::automatic:
+  case sha1_impl::scalar:
+  case sha1_impl::x4: return true;
+#if defined(__x86_64__) || defined(__i386__)
+  case sha1_impl::sha_ni: return cpu_has_sha();
+  case sha1_impl::avx2_x8: return __builtin_cpu_supports("avx2");
+  case sha1_impl::avx512_x16: return __builtin_cpu_supports("avx512f");
+#endif
+  default: return false;
+  }
+}
+
+sha1_impl sha1_best() {
+  // fastest first, by measurement on short messages
+  static const sha1_impl best = [] {
+    for (auto impl: {sha1_impl::avx512_x16, sha1_impl::avx2_x8, sha1_impl::sha_ni, sha1_impl::x4})
+      if (sha1_supported(impl)) return impl;
+    return sha1_impl::scalar;
+  }();
+  return best;
+}
+
+const char* sha1_name(sha1_impl impl) {
+  switch (impl) {
+  case sha1_impl::automatic: return "automatic";
+  case sha1_impl::scalar: return "scalar";
+  case sha1_impl::x4: return "x4";
+  case sha1_impl::sha_ni: return "sha_ni";
+  case sha1_impl::avx2_x8: return "avx2_x8";
+  case sha1_impl::avx512_x16: return "avx512_x16";
+  }
+  return "unknown";
+}
+
+void sha1_batch(std::span<const std::string_view> msgs, std::span<password> out,
+                sha1_impl impl) {
+  if (out.size() < msgs.size()) throw std::domain_error("sha1_batch: out is too small");
+  if (impl == sha1_impl::automatic) impl = sha1_best();
+  if (!sha1_supported(impl))
+    throw std::domain_error(std::string("sha1_batch: ") + sha1_name(impl) +
+                            " is not supported on this cpu");
+
+  for (std::size_t i = 0; i < msgs.size(); ++i) out[i].count = -1;
+
+  switch (impl) {
+#if defined(__x86_64__) || defined(__i386__)
+  case sha1_impl::avx512_x16: hash_grouped<16>(msgs, out, lanes_x16); break;
+  case sha1_impl::avx2_x8: hash_grouped<8>(msgs, out, lanes_x8); break;
+  case sha1_impl::sha_ni:
+    for (std::size_t i = 0; i < msgs.size(); ++i) hash_sha_ni(msgs[i], out[i].hash);
+    break;
+#endif
+  case sha1_impl::x4: hash_grouped<4>(msgs, out, lanes_x4); break;
+  default:
+    for (std::size_t i = 0; i < msgs.size(); ++i) hash_scalar(msgs[i], out[i].hash);
+    break;
+  }
+}
+
+} // namespace hibp
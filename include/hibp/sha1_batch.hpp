@@ -0,0 +1,29 @@
+#pragma once
+
+#include "hibp/password.hpp"
+#include <span>
+#include <string_view>
+
+namespace hibp {
+
+// SHA-1 implementations for hashing many short messages. The multi-buffer ones hash 4, 8 or 16
+// independent messages at once, one per 32 bit SIMD lane.
+enum class sha1_impl {
+  automatic, // fastest supported by this cpu
+  scalar,
+  x4,        // 4 lanes, SSE2 on x86-64 / NEON on arm64
+  sha_ni,    // x86 SHA extensions, one message at a time
+  avx2_x8,   // 8 lanes
+  avx512_x16 // 16 lanes
+};
+
+[[nodiscard]] bool        sha1_supported(sha1_impl impl);
+[[nodiscard]] sha1_impl   sha1_best();
+[[nodiscard]] const char* sha1_name(sha1_impl impl);
+
+// out[i].hash = sha1(msgs[i]), out[i].count = -1, ready for database::search_batch().
+// out.size() must be >= msgs.size(). Throws if impl is not supported on this cpu.
+void sha1_batch(std::span<const std::string_view> msgs, std::span<password> out,
+                sha1_impl impl = sha1_impl::automatic);
+
+} // namespace hibp
@@ -0,0 +1,332 @@
+#include "sharded.hpp"
+#include "count_index.hpp"
+#include "fuse_filter.hpp"
+#include "header.hpp"
+#include "prefix_index.hpp"
+#include "spline_index.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace hibp {
+
+namespace {
+
+// call func(shard) for shards 0..count-1 on up to `threads` threads (0 = all cores), the calling
+// one included. Rethrows the first exception once all threads are done.
+template <typename Func>
+void parallel_for_shards(std::size_t count, unsigned threads, Func func) {
+  if (threads == 0) threads = std::max(1U, std::thread::hardware_concurrency());
+  std::atomic<std::size_t> next = 0;
+  auto                     work = [&] {
+    for (std::size_t s = next++; s < count; s = next++) func(s);
+  };
+
+  std::vector<std::future<void>> helpers;
+  for (std::size_t t = 1; t < std::min<std::size_t>(threads, count); ++t)
+    helpers.push_back(std::async(std::launch::async, work));
+  std::exception_ptr error;
+  try {
+    work();
+  } catch (...) {
+    error = std::current_exception();
+    next  = count; // stop the others early
+  }
+  for (auto& h: helpers) {
+    try {
+      h.get();
+    } catch (...) {
+      if (!error) error = std::current_exception();
+    }
+  }
+  if (error) std::rethrow_exception(error);
+}
+
+void check_shard_bits(unsigned shard_bits) {
+  if (shard_bits == 0 || shard_bits > max_shard_bits)
+    throw std::domain_error("shard_bits must be in 1.." + std::to_string(max_shard_bits));
+}
+
+void build_sidecars(const std::filesystem::path& dbpath, std::size_t shards,
+                    const shard_options& opts) {
+  parallel_for_shards(shards, opts.threads, [&](std::size_t s) {
+    auto path = shard_path(dbpath, s);
+    if (opts.index_bits != 0) build_index(path, opts.index_bits);
+    if (opts.filter) build_filter(path);
+    if (opts.spline) build_spline_index(path);
+  });
+}
+
+template <std::size_t N>
+file_header shard_header(unsigned shard_bits, std::size_t shard) {
+  return {.record_size = sizeof(basic_password<N>),
+          .type        = basic_password<N>::type,
+          .shard_bits  = shard_bits,
+          .shard       = static_cast<std::uint32_t>(shard)};
+}
+
+template <std::size_t N>
+void split(const std::filesystem::path& dbpath, std::size_t data_offset, unsigned shard_bits,
+           const shard_options& opts) {
+  using record = basic_password<N>;
+
+  std::size_t shards = std::size_t{1} << shard_bits;
+
+  // bounds[s] is the first record of shard s: the lower_bound of its smallest prefix
+  std::vector<std::size_t> bounds(shards + 1);
+  {
+    basic_database<N> db(dbpath.string(),
+                         {.acc = access::pread, .use_index = false, .use_filter = false});
+    bounds[shards] = db.size();
+    for (std::size_t s = 1; s < shards; ++s) {
+      std::size_t first = bounds[s - 1];
+      std::size_t count = db.size() - first;
+      while (count > 0) {
+        std::size_t step = count / 2;
+        if (shard_of(db.get(first + step).prefix(), shard_bits) < s) {
+          first += step + 1;
+          count -= step + 1;
+        } else {
+          count = step;
+        }
+      }
+      bounds[s] = first;
+    }
+  }
+
+  pread_file in(dbpath);
+  parallel_for_shards(shards, opts.threads, [&](std::size_t s) {
+    auto          path = shard_path(dbpath, s);
+    std::ofstream os(path, std::ios::binary);
+    if (!os.is_open()) throw std::domain_error("cannot open `" + path.string() + "` for writing");
+    write_header(os, shard_header<N>(shard_bits, s));
+
+    constexpr std::size_t bufcnt = 1U << 16U;
+    std::vector<record>   buf(bufcnt);
+    for (std::size_t pos = bounds[s]; pos < bounds[s + 1];) {
+      std::size_t cnt = std::min(bufcnt, bounds[s + 1] - pos);
+      in.read(buf.data(), cnt * sizeof(record), data_offset + pos * sizeof(record));
+      os.write(reinterpret_cast<const char*>(buf.data()), // NOLINT reincast
+               static_cast<std::streamsize>(cnt * sizeof(record)));
+      pos += cnt;
+    }
+    os.close();
+    if (!os) throw std::domain_error("failed writing `" + path.string() + "`");
+  });
+  build_sidecars(dbpath, shards, opts);
+}
+
+template <std::size_t N>
+std::size_t verify_records(const std::filesystem::path& dbpath,
+                           const std::optional<file_header>& hdr) {
+  // opening checks the .idx and .fuse, if present, against the record count and generation
+  basic_database<N> db(dbpath.string());
+  auto              stale = [&](const auto& sidecar) {
+    return sidecar.records() != db.size() || sidecar.generation() != db.generation();
+  };
+  if (auto cntpath = count_index::sidecar_path(dbpath);
+      std::filesystem::exists(cntpath) && stale(count_index(cntpath)))
+    throw std::domain_error("stale count index: " + cntpath.string());
+  if (auto splpath = spline_index::sidecar_path(dbpath);
+      std::filesystem::exists(splpath) && stale(spline_index(splpath)))
+    throw std::domain_error("stale learned index: " + splpath.string());
+
+  unsigned          shard_bits = hdr ? hdr->shard_bits : 0;
+  std::size_t       shard      = hdr ? hdr->shard : 0;
+  std::size_t       pos        = 0;
+  basic_password<N> prev{};
+  db.for_each([&](const basic_password<N>& pw) {
+    if (pos > 0 && !(prev < pw)) // NOLINT weird nullptr warning
+      throw std::domain_error(dbpath.string() + ": record " + std::to_string(pos) +
+                              (prev == pw ? " repeats a hash" : " is out of order"));
+    if (shard_of(pw.prefix(), shard_bits) != shard)
+      throw std::domain_error(dbpath.string() + ": record " + std::to_string(pos) +
+                              " does not belong in shard " + std::to_string(shard));
+    prev = pw;
+    ++pos;
+    return true;
+  });
+  return pos;
+}
+
+} // namespace
+
+std::filesystem::path shard_path(const std::filesystem::path& dbpath, std::size_t shard) {
+  constexpr std::array<char, 16> digits = {'0', '1', '2', '3', '4', '5', '6', '7',
+                                           '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
+
+  auto path = dbpath;
+  auto ext  = path.extension().string();
+  path.replace_extension();
+  path += std::string{'.', digits.at(shard >> 4U & 0xFU), digits.at(shard & 0xFU)} + ext;
+  return path;
+}
+
+bool is_sharded(const std::filesystem::path& dbpath) {
+  if (!std::filesystem::exists(shard_path(dbpath, 0))) return false;
+  if (std::filesystem::exists(dbpath))
+    throw std::domain_error("both `" + dbpath.string() + "` and its shards exist: remove one");
+  return true;
+}
+
+template <std::size_t N>
+void build_sharded(std::istream& text_stream, const std::filesystem::path& dbpath,
+                   unsigned shard_bits, const shard_options& opts) {
+  using record = basic_password<N>;
+  check_shard_bits(shard_bits);
+  if (std::filesystem::exists(dbpath))
+    throw std::domain_error("`" + dbpath.string() + "` exists: shard it, or remove it first");
+
+  std::size_t                shards = std::size_t{1} << shard_bits;
+  std::vector<std::ofstream> files(shards);
+  for (std::size_t s = 0; s < shards; ++s) {
+    auto path = shard_path(dbpath, s);
+    files[s].open(path, std::ios::binary);
+    if (!files[s].is_open())
+      throw std::domain_error("cannot open `" + path.string() + "` for writing");
+    write_header(files[s], shard_header<N>(shard_bits, s));
+  }
+
+  // sorted text puts each shard's records in one run, which is written at once
+  auto shard = [&](const record& pw) { return shard_of(pw.prefix(), shard_bits); };
+  for_each_parsed_chunk<N>(text_stream, opts.threads, [&](std::vector<record> pws) {
+    for (auto first = pws.begin(); first != pws.end();) {
+      auto s    = shard(*first);
+      auto last = std::find_if(first, pws.end(), [&](const record& pw) { return shard(pw) != s; });
+      files[s].write(reinterpret_cast<const char*>(&*first), // NOLINT reincast
+                     static_cast<std::streamsize>(sizeof(record)) * (last - first));
+      first = last;
+    }
+  });
+
+  for (std::size_t s = 0; s < shards; ++s) {
+    files[s].close();
+    if (!files[s])
+      throw std::domain_error("failed writing `" + shard_path(dbpath, s).string() + "`");
+  }
+  build_sidecars(dbpath, shards, opts);
+}
+
+template void build_sharded<20>(std::istream& text_stream, const std::filesystem::path& dbpath,
+                                unsigned shard_bits, const shard_options& opts);
+template void build_sharded<16>(std::istream& text_stream, const std::filesystem::path& dbpath,
+                                unsigned shard_bits, const shard_options& opts);
+
+void split_shards(const std::filesystem::path& dbpath, unsigned shard_bits,
+                  const shard_options& opts) {
+  check_shard_bits(shard_bits);
+  is_sharded(dbpath); // throws if some shards exist already
+  auto hdr = read_header(dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("sharding requires a sorted db: " + dbpath.string());
+  if (hdr && hdr->shard_bits != 0)
+    throw std::domain_error(dbpath.string() + " is already a shard");
+
+  std::size_t data_offset = hdr ? sizeof(file_header) : 0;
+  if (hdr && hdr->type == hash_type::ntlm)
+    split<16>(dbpath, data_offset, shard_bits, opts);
+  else
+    split<20>(dbpath, data_offset, shard_bits, opts);
+
+  // the shards replace dbpath, so no command can pick the stale one of the two
+  for (auto&& sidecar: {prefix_index::sidecar_path(dbpath), fuse_filter::sidecar_path(dbpath),
+                        count_index::sidecar_path(dbpath), spline_index::sidecar_path(dbpath)})
+    std::filesystem::remove(sidecar);
+  std::filesystem::remove(dbpath);
+}
+
+std::size_t verify(const std::filesystem::path& dbpath) {
+  auto hdr = read_header(dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("verify requires a sorted db: " + dbpath.string());
+  if (hdr && hdr->shard_bits > max_shard_bits)
+    throw std::domain_error(dbpath.string() + ": invalid shard_bits");
+  if (hdr && hdr->type == hash_type::ntlm) return verify_records<16>(dbpath, hdr);
+  return verify_records<20>(dbpath, hdr);
+}
+
+std::size_t verify_sharded(const std::filesystem::path& dbpath, unsigned threads) {
+  auto first = read_header(shard_path(dbpath, 0));
+  if (!first || first->shard_bits == 0 || first->shard_bits > max_shard_bits)
+    throw std::domain_error(shard_path(dbpath, 0).string() + " is not a shard");
+
+  std::size_t              shards = std::size_t{1} << first->shard_bits;
+  std::vector<std::size_t> records(shards);
+  parallel_for_shards(shards, threads, [&](std::size_t s) {
+    auto path = shard_path(dbpath, s);
+    auto hdr  = read_header(path);
+    if (!hdr || hdr->shard_bits != first->shard_bits || hdr->shard != s || hdr->type != first->type)
+      throw std::domain_error(path.string() + " is not shard " + std::to_string(s) + " of " +
+                              std::to_string(shards) + " of this db");
+    records[s] = verify(path);
+  });
+  std::size_t total = 0;
+  for (auto r: records) total += r;
+  return total;
+}
+
+// hibp::basic_sharded_database
+
+template <std::size_t N>
+basic_sharded_database<N>::basic_sharded_database(const std::filesystem::path& dbpath,
+                                                  db_options                   opts) {
+  auto first = read_header(shard_path(dbpath, 0));
+  if (!first || first->shard_bits == 0 || first->shard_bits > max_shard_bits)
+    throw std::domain_error(shard_path(dbpath, 0).string() + " is not a shard");
+  bits_ = first->shard_bits;
+
+  std::size_t shards = std::size_t{1} << bits_;
+  shards_.reserve(shards);
+  for (std::size_t s = 0; s < shards; ++s) {
+    auto path = shard_path(dbpath, s);
+    auto hdr  = read_header(path);
+    if (!hdr || hdr->shard_bits != bits_ || hdr->shard != s)
+      throw std::domain_error(path.string() + " is not shard " + std::to_string(s) + " of " +
+                              std::to_string(shards) + " of this db");
+    shards_.push_back(std::make_unique<basic_database<N>>(path.string(), opts));
+  }
+}
+
+template <std::size_t N>
+std::vector<std::optional<basic_password<N>>>
+basic_sharded_database<N>::search_batch(std::span<const record> needles, unsigned threads) const {
+  std::vector<std::vector<std::size_t>> groups(shards_.size()); // into needles
+  for (std::size_t i = 0; i < needles.size(); ++i)
+    groups[shard_of(needles[i].prefix(), bits_)].push_back(i);
+
+  std::vector<std::optional<record>> results(needles.size());
+  parallel_for_shards(shards_.size(), threads, [&](std::size_t s) {
+    if (groups[s].empty()) return;
+    std::vector<record> group;
+    group.reserve(groups[s].size());
+    for (auto i: groups[s]) group.push_back(needles[i]);
+    auto found = shards_[s]->search_batch(group);
+    for (std::size_t j = 0; j < found.size(); ++j) results[groups[s][j]] = found[j];
+  });
+  return results;
+}
+
+template <std::size_t N>
+std::size_t basic_sharded_database<N>::size() const {
+  std::size_t total = 0;
+  for (auto&& s: shards_) total += s->size();
+  return total;
+}
+
+template <std::size_t N>
+std::size_t basic_sharded_database<N>::probes() const {
+  std::size_t total = 0;
+  for (auto&& s: shards_) total += s->probes();
+  return total;
+}
+
+template class basic_sharded_database<20>;
+template class basic_sharded_database<16>;
+
+} // namespace hibp
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "hibp/hibp.hpp"
+#include "hibp/password.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace hibp {
+
+// A sharded db is split into 2^shard_bits files by the leading bits of the hash, "hibp.bin"
+// becoming "hibp.00.bin", "hibp.01.bin" and so on. Each shard is an ordinary sorted .bin whose
+// header records which shard it is, so it can be searched, indexed, updated, verified or copied
+// on its own, and moved to another disk behind a symlink. Lookups go straight to the one shard
+// which can hold the hash.
+
+constexpr unsigned max_shard_bits = 8; // 256 files, plus their sidecars, all held open
+
+// the shard of 2^shard_bits which holds hashes with this password::prefix()
+constexpr std::size_t shard_of(std::uint64_t prefix, unsigned shard_bits) {
+  return shard_bits == 0 ? 0 : static_cast<std::size_t>(prefix >> (64 - shard_bits));
+}
+
+// path of shard number `shard` of the sharded db at dbpath
+std::filesystem::path shard_path(const std::filesystem::path& dbpath, std::size_t shard);
+
+// true if dbpath names a sharded db, ie its first shard exists. Throws if dbpath exists as well,
+// rather than guess which of the two is meant.
+bool is_sharded(const std::filesystem::path& dbpath);
+
+struct shard_options {
+  unsigned threads = 0; // for parsing, copying and sidecars, 0 = all cores
+  // sidecars to build for every shard, in parallel, once the shards are written
+  unsigned index_bits = 0; // .idx, 0 = none. Only 2^(index_bits - shard_bits) buckets are used
+  bool     filter     = false; // .fuse
+  bool     spline     = false; // .spl, at spline_index::default_error
+};
+
+// Like build(), but writes the shards of dbpath, which must not exist as a single file. Parsing
+// is parallel as for build(), and each parsed chunk is split between the shards it covers: one or
+// two for sorted text.
+template <std::size_t N = 20>
+void build_sharded(std::istream& text_stream, const std::filesystem::path& dbpath,
+                   unsigned shard_bits, const shard_options& opts = {});
+
+// Split an existing sorted .bin into the shards of the same name, which replace it: once they
+// are all written, dbpath and its sidecars are removed. The boundaries are found by bisection,
+// and the shards copied in parallel.
+void split_shards(const std::filesystem::path& dbpath, unsigned shard_bits,
+                  const shard_options& opts = {});
+
+// Read a sorted .bin, or a single shard, from end to end and check that the hashes are strictly
+// ascending, belong to the shard the header claims and that any sidecars are current. Returns
+// the number of records, throws on the first problem.
+std::size_t verify(const std::filesystem::path& dbpath);
+
+// verify() every shard of a sharded db, in parallel, and that they form a complete set
+std::size_t verify_sharded(const std::filesystem::path& dbpath, unsigned threads = 0);
+
+// Searches a sharded db of N byte hashes: one basic_database per shard, opened with the same
+// options. Like basic_database, all members are const and safe to call from many threads.
+template <std::size_t N>
+class basic_sharded_database {
+public:
+  using record = basic_password<N>;
+
+  explicit basic_sharded_database(const std::filesystem::path& dbpath, db_options opts = {});
+
+  std::optional<record> search(const record& needle) const {
+    return shard_for(needle).search(needle);
+  }
+
+  // The needles are grouped by shard and each shard's group searched with its search_batch, on
+  // up to one thread per shard, so shards on separate disks are read concurrently. Results are
+  // in input order.
+  std::vector<std::optional<record>> search_batch(std::span<const record> needles,
+                                                  unsigned threads = 0) const;
+
+  [[nodiscard]] const basic_database<N>& shard(std::size_t i) const { return *shards_[i]; }
+  [[nodiscard]] const basic_database<N>& shard_for(const record& pw) const {
+    return *shards_[shard_of(pw.prefix(), bits_)];
+  }
+
+  [[nodiscard]] unsigned    shard_bits() const { return bits_; }
+  [[nodiscard]] std::size_t shards() const { return shards_.size(); }
+  [[nodiscard]] std::size_t size() const;   // records in all shards
+  [[nodiscard]] std::size_t probes() const; // of all shards
+
+private:
+  unsigned                                        bits_ = 0;
+  std::vector<std::unique_ptr<basic_database<N>>> shards_; // not movable: they hold a mutex
+};
+
+using sharded_database      = basic_sharded_database<20>;
+using ntlm_sharded_database = basic_sharded_database<16>;
+
+extern template class basic_sharded_database<20>;
+extern template class basic_sharded_database<16>;
+
+} // namespace hibp
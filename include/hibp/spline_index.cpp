@@ -0,0 +1,178 @@
+#include "spline_index.hpp"
+#include "header.hpp"
+#include "hibp.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace hibp {
+
+namespace {
+
+struct spline_header {
+  std::array<char, 8> magic;
+  std::uint32_t       error;
+  std::uint32_t       generation; // of the db, was reserved so 0 in older files, as in their .bin
+  std::uint64_t       records;
+  std::uint64_t       knots;
+};
+
+constexpr std::array<char, 8> spline_magic = {'H', 'I', 'B', 'P', 'S', 'P', 'L', '1'};
+
+// keys span 64 bits and positions ~40, so the corridor's cross products are exact in 128 bits
+__extension__ using int128 = __int128;
+
+// > 0 if (dx2, dy2) turns clockwise from (dx1, dy1), < 0 if anticlockwise, 0 if collinear. For
+// dx1, dx2 > 0: > 0 if the slope of the second is below that of the first
+int128 orientation(int128 dx1, int128 dy1, int128 dx2, int128 dy2) {
+  return dy1 * dx2 - dy2 * dx1;
+}
+
+template <std::size_t N>
+void add_all(const std::filesystem::path& dbpath, spline_index& idx) {
+  basic_database<N> db(dbpath.string(), {.use_index = false, .use_filter = false});
+  db.for_each([&](const basic_password<N>& pw) {
+    idx.add(pw);
+    return true;
+  });
+}
+
+} // namespace
+
+spline_index::spline_index(unsigned error) : error_(error) {
+  if (error_ == 0 || error_ > max_error)
+    throw std::domain_error("spline_index error must be in 1.." + std::to_string(max_error));
+}
+
+spline_index::spline_index(const std::filesystem::path& path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is.is_open()) throw std::domain_error("cannot open learned index: " + path.string());
+
+  spline_header hdr{};
+  is.read(reinterpret_cast<char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  if (!is || hdr.magic != spline_magic || hdr.error == 0 || hdr.error > max_error ||
+      (hdr.knots == 0) != (hdr.records == 0) || hdr.knots > hdr.records)
+    throw std::domain_error("not a valid hibp learned index file: " + path.string());
+
+  error_      = hdr.error;
+  records_    = hdr.records;
+  generation_ = hdr.generation;
+  knots_.resize(hdr.knots);
+  is.read(reinterpret_cast<char*>(knots_.data()), // NOLINT reincast
+          static_cast<std::streamsize>(knots_.size() * sizeof(knot)));
+  if (!is) throw std::domain_error("truncated hibp learned index file: " + path.string());
+  make_radix();
+}
+
+// Greedy spline corridor: the lines from the last knot through every point since, give or take
+// error_ positions, must have a slope in common. upper_ and lower_ are the points which bound
+// those slopes. When a new point leaves that corridor, the previous one becomes a knot.
+void spline_index::add_key(std::uint64_t key) {
+  std::uint64_t pos = records_++;
+  if (pos == 0) {
+    knots_.push_back({key, 0});
+    prev_ = knots_.back();
+    return;
+  }
+  if (key < prev_.key) throw std::domain_error("spline_index: input is not sorted by hash");
+  if (key == prev_.key) return; // same 64 bit prefix: range() allows for the next position
+
+  auto upper = static_cast<std::int64_t>(pos + error_);
+  auto lower = static_cast<std::int64_t>(pos) - error_;
+  if (prev_.key == knots_.back().key) { // the first point after the first knot
+    upper_ = {key, upper};
+    lower_ = {key, lower};
+    prev_  = {key, pos};
+    return;
+  }
+
+  const knot& last = knots_.back();
+  auto        dy   = [&](std::int64_t p) { return int128{p} - int128{last.pos}; };
+  int128      dx   = key - last.key;
+  int128      udx  = upper_.key - last.key;
+  int128      ldx  = lower_.key - last.key;
+  int128      udy  = dy(upper_.pos);
+  int128      ldy  = dy(lower_.pos);
+
+  auto p = static_cast<std::int64_t>(pos);
+  if (orientation(udx, udy, dx, dy(p)) < 0 || orientation(ldx, ldy, dx, dy(p)) > 0) {
+    knots_.push_back(prev_);
+    upper_ = {key, upper};
+    lower_ = {key, lower};
+  } else {
+    if (orientation(udx, udy, dx, dy(upper)) > 0) upper_ = {key, upper};
+    if (orientation(ldx, ldy, dx, dy(lower)) < 0) lower_ = {key, lower};
+  }
+  prev_ = {key, pos};
+}
+
+void spline_index::save(const std::filesystem::path& path, std::uint32_t generation) {
+  if (!knots_.empty() && knots_.back().key != prev_.key) knots_.push_back(prev_); // close
+
+  std::ofstream os(path, std::ios::binary);
+  if (!os.is_open())
+    throw std::domain_error("cannot open learned index for writing: " + path.string());
+
+  spline_header hdr{.magic      = spline_magic,
+                    .error      = error_,
+                    .generation = generation,
+                    .records    = records_,
+                    .knots      = knots_.size()};
+  os.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr)); // NOLINT reincast
+  os.write(reinterpret_cast<const char*>(knots_.data()),      // NOLINT reincast
+           static_cast<std::streamsize>(knots_.size() * sizeof(knot)));
+  if (!os) throw std::domain_error("failed writing learned index: " + path.string());
+}
+
+// about one knot per radix bucket
+void spline_index::make_radix() {
+  auto bits    = std::clamp(static_cast<unsigned>(std::bit_width(knots_.size())), 1U, 24U);
+  radix_shift_ = 64 - bits;
+  radix_.resize((std::size_t{1} << bits) + 1);
+  std::size_t k = 0;
+  for (std::size_t b = 0; b < radix_.size(); ++b) {
+    while (k < knots_.size() && (knots_[k].key >> radix_shift_) < b) ++k;
+    radix_[b] = static_cast<std::uint32_t>(k);
+  }
+}
+
+std::pair<std::size_t, std::size_t> spline_index::range(std::uint64_t key) const {
+  if (knots_.empty()) return {0, 0};
+
+  // the segment starting at the last knot <= key
+  std::size_t b     = key >> radix_shift_;
+  auto        later = [](std::uint64_t k, const knot& n) { return k < n.key; };
+  auto        next  = std::upper_bound(knots_.begin() + radix_[b], knots_.begin() + radix_[b + 1],
+                                       key, later);
+  if (next == knots_.begin()) return {0, 0}; // below the first record
+  const knot& from = *std::prev(next);
+
+  auto predicted = static_cast<double>(from.pos);
+  if (next != knots_.end())
+    predicted += static_cast<double>(key - from.key) / static_cast<double>(next->key - from.key) *
+                 static_cast<double>(next->pos - from.pos);
+
+  // The lower_bound is within error_ of the predictions for the keys either side of it, plus
+  // one for a repeated prefix and one for rounding.
+  auto        centre = static_cast<std::size_t>(predicted);
+  std::size_t slack  = error_ + 2;
+  return {centre > slack ? centre - slack : 0, std::min(records_, centre + slack + 2)};
+}
+
+void build_spline_index(const std::filesystem::path& dbpath, unsigned error) {
+  auto hdr = read_header(dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("a learned index requires a sorted db: " + dbpath.string());
+
+  spline_index idx(error);
+  if (hdr && hdr->type == hash_type::ntlm)
+    add_all<16>(dbpath, idx);
+  else
+    add_all<20>(dbpath, idx);
+  idx.save(spline_index::sidecar_path(dbpath), hdr ? hdr->generation : 0);
+}
+
+} // namespace hibp
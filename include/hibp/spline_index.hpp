@@ -0,0 +1,83 @@
+#pragma once
+
+#include "hibp/password.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+// A learned index: record position as a piecewise linear function of password::prefix(), with
+// the knots chosen by a greedy spline corridor (as in RadixSpline), so every prediction is
+// within error() records of the truth. A search then needs a single read of the ~2 * error()
+// records around the prediction. Hashes are uniform, so positions drift from a straight line
+// like a random walk, and a segment covers ~error()^2 records: 16 bytes per knot makes ~7KB per
+// 2M records at the default error. A radix table over the knots, made on load, finds the
+// segment in about one step. Stored as a sidecar file next to the .bin (see sidecar_path()).
+class spline_index {
+public:
+  static constexpr unsigned default_error = 64;  // window of ~3KB of sha1 records, 1-2 pages
+  static constexpr unsigned max_error     = 256; // keeps a search's window on the stack
+
+  // an empty index, ready for add()
+  explicit spline_index(unsigned error = default_error);
+
+  // load a previously save()'d index
+  explicit spline_index(const std::filesystem::path& path);
+
+  // passwords must be added in sorted order, one call per record in the .bin
+  template <std::size_t N>
+  void add(const basic_password<N>& pw) {
+    add_key(pw.prefix());
+  }
+  // stamped with the file_header::generation of the .bin it indexes
+  void save(const std::filesystem::path& path, std::uint32_t generation = 0);
+
+  // [first, last) record positions which could contain needle, at most 2 * error() + 6 of them
+  template <std::size_t N>
+  [[nodiscard]] std::pair<std::size_t, std::size_t> range(const basic_password<N>& needle) const {
+    return range(needle.prefix());
+  }
+
+  [[nodiscard]] unsigned      error() const { return error_; }
+  [[nodiscard]] std::size_t   records() const { return records_; }
+  [[nodiscard]] std::size_t   knots() const { return knots_.size(); }
+  [[nodiscard]] std::uint32_t generation() const { return generation_; }
+
+  static std::filesystem::path sidecar_path(const std::filesystem::path& dbpath) {
+    return dbpath.string() + ".spl";
+  }
+
+private:
+  struct knot {
+    std::uint64_t key;
+    std::uint64_t pos;
+  };
+  struct point { // a corridor limit, which may lie below position 0
+    std::uint64_t key;
+    std::int64_t  pos;
+  };
+
+  void add_key(std::uint64_t key);
+  void make_radix();
+
+  [[nodiscard]] std::pair<std::size_t, std::size_t> range(std::uint64_t key) const;
+
+  unsigned                   error_;
+  std::vector<knot>          knots_;
+  std::vector<std::uint32_t> radix_; // load only: knots_ [radix_[b], radix_[b+1]) share prefix b
+  unsigned                   radix_shift_ = 0;
+  std::size_t                records_     = 0;
+  std::uint32_t              generation_  = 0; // loaded only, see save()
+  knot                       prev_{};  // build only: the last distinct key added
+  point                      upper_{}; // build only: the corridor from knots_.back()
+  point                      lower_{};
+};
+
+// (re)generate the learned index for an existing sorted .bin in one sequential pass
+void build_spline_index(const std::filesystem::path& dbpath,
+                        unsigned                     error = spline_index::default_error);
+
+} // namespace hibp
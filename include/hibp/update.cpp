@@ -0,0 +1,170 @@
+#include "update.hpp"
+#include "hibp/count_index.hpp"
+#include "hibp/fuse_filter.hpp"
+#include "hibp/header.hpp"
+#include "hibp/hibp.hpp"
+#include "hibp/password.hpp"
+#include "hibp/prefix_index.hpp"
+#include "hibp/sharded.hpp"
+#include "hibp/spline_index.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace hibp {
+
+namespace {
+
+// flush a file (or directory entry) to stable storage, so a rename can't expose a torn file
+void sync_path(const std::filesystem::path& path, bool directory = false) {
+  int fd = ::open(path.c_str(), directory ? O_RDONLY | O_DIRECTORY : O_RDONLY);
+  if (fd == -1)
+    throw std::domain_error("cannot open `" + path.string() + "`: " + std::strerror(errno));
+  int ret = ::fsync(fd);
+  ::close(fd);
+  if (ret == -1)
+    throw std::domain_error("fsync of `" + path.string() + "` failed: " + std::strerror(errno));
+}
+
+std::vector<password> read_delta(std::istream& delta_text) {
+  std::vector<password> delta;
+  for_each_text_chunk(delta_text, 16U << 20U, [&](std::string chunk) {
+    auto pws = parse_text(chunk);
+    delta.insert(delta.end(), pws.begin(), pws.end());
+  });
+  for (std::size_t i = 1; i < delta.size(); ++i)
+    if (!(delta[i - 1] < delta[i])) // NOLINT weird nullptr warning
+      throw std::domain_error("delta is not sorted, or repeats a hash, at line " +
+                              std::to_string(i + 1));
+  return delta;
+}
+
+} // namespace
+
+update_stats update(const std::filesystem::path& dbpath, std::istream& delta_text) {
+  auto hdr = read_header(dbpath);
+  require_hash_type(hdr, hash_type::sha1, dbpath);
+  if (hdr && hdr->order != layout::sorted)
+    throw std::domain_error("update requires a sorted db: " + dbpath.string());
+
+  std::vector<password> delta = read_delta(delta_text);
+  if (hdr && hdr->shard_bits != 0)
+    for (auto&& pw: delta)
+      if (shard_of(pw.prefix(), hdr->shard_bits) != hdr->shard)
+        throw std::domain_error("delta holds hashes outside shard " + std::to_string(hdr->shard) +
+                                ": " + dbpath.string());
+
+  // carry over the sidecars the old file had, the indexes with the same resolution
+  auto                        idxpath  = prefix_index::sidecar_path(dbpath);
+  auto                        fusepath = fuse_filter::sidecar_path(dbpath);
+  std::optional<prefix_index> index;
+  if (std::filesystem::exists(idxpath)) index.emplace(prefix_index(idxpath).bits());
+  bool                       has_filter = std::filesystem::exists(fusepath);
+  std::vector<std::uint64_t> keys;
+  auto                       cntpath = count_index::sidecar_path(dbpath);
+  std::optional<count_index> counts;
+  if (std::filesystem::exists(cntpath)) counts.emplace();
+  auto                        splpath = spline_index::sidecar_path(dbpath);
+  std::optional<spline_index> spline;
+  if (std::filesystem::exists(splpath)) spline.emplace(spline_index(splpath).error());
+
+  std::filesystem::path newpath = dbpath.string() + ".new"; // same filesystem, so rename works
+  auto                  newidx  = prefix_index::sidecar_path(newpath);
+  auto                  newfuse = fuse_filter::sidecar_path(newpath);
+  auto                  newcnt  = count_index::sidecar_path(newpath);
+  auto                  newspl  = spline_index::sidecar_path(newpath);
+
+  // the next generation, which the new sidecars carry too. A headerless file gains a header for it
+  file_header newhdr = hdr ? *hdr : file_header{};
+  newhdr.version     = file_header::current_version;
+  ++newhdr.generation;
+
+  update_stats stats;
+  try {
+    std::ofstream os(newpath, std::ios::binary);
+    if (!os.is_open())
+      throw std::domain_error("cannot open `" + newpath.string() + "` for writing");
+    write_header(os, newhdr);
+
+    constexpr std::size_t obufcnt = 1U << 16U;
+    std::vector<password> obuf;
+    obuf.reserve(obufcnt);
+    auto emit = [&](const password& pw) {
+      obuf.push_back(pw);
+      if (index) index->add(pw);
+      if (has_filter) keys.push_back(pw.prefix());
+      if (counts) counts->add(pw);
+      if (spline) spline->add(pw);
+      if (obuf.size() == obufcnt) {
+        os.write(reinterpret_cast<const char*>(obuf.data()), // NOLINT reincast
+                 static_cast<std::streamsize>(sizeof(password) * obuf.size()));
+        obuf.clear();
+      }
+    };
+
+    // for_each reads in large sequential blocks, stream access keeps the kernel's read-ahead
+    database db(dbpath.string(), {.use_index = false, .use_filter = false});
+    auto     it = delta.begin();
+    db.for_each([&](const password& pw) {
+      for (; it != delta.end() && *it < pw; ++it, ++stats.added) emit(*it);
+      if (it != delta.end() && *it == pw) {
+        password merged = *it++;
+        if (merged.count < 0) merged.count = pw.count;
+        if (merged.count != pw.count) ++stats.changed;
+        emit(merged);
+      } else {
+        emit(pw);
+      }
+      return true;
+    });
+    for (; it != delta.end(); ++it, ++stats.added) emit(*it);
+    os.write(reinterpret_cast<const char*>(obuf.data()), // NOLINT reincast
+             static_cast<std::streamsize>(sizeof(password) * obuf.size()));
+    os.close();
+    if (!os) throw std::domain_error("failed writing `" + newpath.string() + "`");
+    stats.records = db.size() + stats.added;
+
+    sync_path(newpath);
+    if (index) {
+      index->save(newidx, newhdr.generation);
+      sync_path(newidx);
+    }
+    if (has_filter) {
+      fuse_filter(std::move(keys)).save(newfuse, newhdr.generation);
+      sync_path(newfuse);
+    }
+    if (counts) {
+      counts->save(newcnt, newhdr.generation);
+      sync_path(newcnt);
+    }
+    if (spline) {
+      spline->save(newspl, newhdr.generation);
+      sync_path(newspl);
+    }
+  } catch (...) {
+    std::filesystem::remove(newpath);
+    std::filesystem::remove(newidx);
+    std::filesystem::remove(newfuse);
+    std::filesystem::remove(newcnt);
+    std::filesystem::remove(newspl);
+    throw;
+  }
+
+  std::filesystem::rename(newpath, dbpath);
+  if (index) std::filesystem::rename(newidx, idxpath);
+  if (has_filter) std::filesystem::rename(newfuse, fusepath);
+  if (counts) std::filesystem::rename(newcnt, cntpath);
+  if (spline) std::filesystem::rename(newspl, splpath);
+  sync_path(dbpath.has_parent_path() ? dbpath.parent_path() : ".", true);
+  return stats;
+}
+
+} // namespace hibp
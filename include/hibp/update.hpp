@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <istream>
+
+namespace hibp {
+
+struct update_stats {
+  std::size_t added   = 0; // hashes not in the old file
+  std::size_t changed = 0; // existing hashes whose count changed
+  std::size_t records = 0; // in the new file
+};
+
+// Merge a delta into the sorted .bin at dbpath, in one sequential pass over the old file. The
+// delta is hibp text in ascending hash order, as published with each release: new hashes are
+// inserted, and existing ones take the delta's count (a line without a count keeps the old one).
+// The delta is held in RAM, 24 bytes per line. To update a shard, pass it only that shard's
+// lines.
+//
+// The new file and any sidecars the old one had (.idx with the same bits, .fuse, .cnt, .spl with
+// the same error) are written next to it, stamped with the next file_header::generation, fsync'd
+// and renamed over the originals. A headerless file gains a header to hold the generation.
+// Databases already open keep reading the old version, while opening one sees the new version. A
+// database opened in the short gap between renaming the .bin and its sidecars finds that their
+// generations differ, rejects the sidecars as stale, and can simply be retried.
+update_stats update(const std::filesystem::path& dbpath, std::istream& delta_text);
+
+} // namespace hibp
@@ -0,0 +1,138 @@
+#include "uring.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace hibp {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(
+      ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+template <typename T>
+T* at(void* base, std::uint32_t offset) {
+  return reinterpret_cast<T*>(static_cast<char*>(base) + offset); // NOLINT reincast
+}
+
+void* map_ring(int fd, std::size_t size, std::uint64_t offset) {
+  void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                   static_cast<off_t>(offset));
+  if (p == MAP_FAILED) // NOLINT int to ptr cast in macro
+    throw std::domain_error(std::string("io_uring mmap failed: ") + std::strerror(errno));
+  return p;
+}
+
+} // namespace
+
+uring::uring(unsigned entries) {
+  io_uring_params params{};
+  fd_ = io_uring_setup(entries, &params);
+  if (fd_ == -1)
+    throw std::domain_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+
+  try {
+    sq_entries_ = params.sq_entries;
+    sq_ring_sz_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_sz_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0) {
+      sq_ring_sz_ = cq_ring_sz_ = std::max(sq_ring_sz_, cq_ring_sz_);
+      sq_ring_ = cq_ring_ = map_ring(fd_, sq_ring_sz_, IORING_OFF_SQ_RING);
+    } else {
+      sq_ring_ = map_ring(fd_, sq_ring_sz_, IORING_OFF_SQ_RING);
+      cq_ring_ = map_ring(fd_, cq_ring_sz_, IORING_OFF_CQ_RING);
+    }
+    sqes_sz_  = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_map_ = map_ring(fd_, sqes_sz_, IORING_OFF_SQES);
+  } catch (...) {
+    release(); // the destructor won't run
+    throw;
+  }
+
+  sq_head_  = at<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_  = at<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_  = at<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = at<unsigned>(sq_ring_, params.sq_off.array);
+  sqes_     = static_cast<io_uring_sqe*>(sqes_map_);
+  cq_head_  = at<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_  = at<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_  = at<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cqes_     = at<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+}
+
+uring::~uring() { release(); }
+
+void uring::release() noexcept {
+  if (sqes_map_ != nullptr) ::munmap(sqes_map_, sqes_sz_);
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_sz_);
+  if (sq_ring_ != nullptr) ::munmap(sq_ring_, sq_ring_sz_);
+  if (fd_ != -1) ::close(fd_);
+  sqes_map_ = cq_ring_ = sq_ring_ = nullptr;
+  fd_                             = -1;
+}
+
+bool uring::supported() {
+  io_uring_params params{};
+  int             fd = io_uring_setup(1, &params);
+  if (fd == -1) return false;
+  ::close(fd);
+  return true;
+}
+
+bool uring::prep_read(int fd, void* buf, unsigned size, std::uint64_t offset, std::uint64_t tag) {
+  unsigned tail = *sq_tail_; // only we write it
+  if (tail - std::atomic_ref(*sq_head_).load(std::memory_order_acquire) >= sq_entries_)
+    return false;
+
+  unsigned      idx = tail & *sq_mask_;
+  io_uring_sqe& sqe = sqes_[idx];
+  std::memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode     = IORING_OP_READ;
+  sqe.fd         = fd;
+  sqe.addr       = reinterpret_cast<std::uint64_t>(buf); // NOLINT reincast
+  sqe.len        = size;
+  sqe.off        = offset;
+  sqe.user_data  = tag;
+  sq_array_[idx] = idx;
+  std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+  ++to_submit_;
+  return true;
+}
+
+void uring::submit_and_wait(unsigned min_complete) {
+  while (true) {
+    int ret = io_uring_enter(fd_, to_submit_, min_complete, IORING_ENTER_GETEVENTS);
+    if (ret >= 0) {
+      to_submit_ -= static_cast<unsigned>(ret);
+      if (to_submit_ == 0) return;
+      continue; // partial submission, the rest next time round
+    }
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+    throw std::domain_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+  }
+}
+
+bool uring::pop_completion(std::uint64_t& tag, int& res) {
+  unsigned head = *cq_head_; // only we write it
+  if (head == std::atomic_ref(*cq_tail_).load(std::memory_order_acquire)) return false;
+  const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+  tag                     = cqe.user_data;
+  res                     = cqe.res;
+  std::atomic_ref(*cq_head_).store(head + 1, std::memory_order_release);
+  return true;
+}
+
+} // namespace hibp
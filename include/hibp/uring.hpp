@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace hibp {
+
+// Minimal io_uring instance for positioned reads, on the raw syscalls (no liburing). Linux 5.6+.
+// Not thread safe: one ring per thread, or per call.
+class uring {
+public:
+  // room for at least `entries` reads in flight
+  explicit uring(unsigned entries);
+
+  uring(const uring& m) = delete;
+  uring& operator=(const uring& other) = delete;
+
+  uring(uring&& other) noexcept = delete;
+  uring& operator=(uring&& other) noexcept = delete;
+
+  ~uring();
+
+  // can this process create rings? (they are often disabled by sysctl or seccomp in containers)
+  static bool supported();
+
+  [[nodiscard]] unsigned entries() const { return sq_entries_; }
+
+  // queue a read of size bytes at offset of fd into buf. False if the submission queue is full.
+  // tag is returned with the completion.
+  bool prep_read(int fd, void* buf, unsigned size, std::uint64_t offset, std::uint64_t tag);
+
+  // submit everything queued and wait until at least min_complete completions are available
+  void submit_and_wait(unsigned min_complete);
+
+  // Take the next available completion. res is the byte count or -errno, as for pread().
+  bool pop_completion(std::uint64_t& tag, int& res);
+
+private:
+  void release() noexcept;
+
+  int         fd_         = -1;
+  unsigned    sq_entries_ = 0;
+  unsigned    to_submit_  = 0;
+  void*       sq_ring_    = nullptr;
+  std::size_t sq_ring_sz_ = 0;
+  void*       cq_ring_    = nullptr; // may be == sq_ring_
+  std::size_t cq_ring_sz_ = 0;
+  void*       sqes_map_   = nullptr;
+  std::size_t sqes_sz_    = 0;
+
+  // into the shared rings
+  unsigned*     sq_head_  = nullptr;
+  unsigned*     sq_tail_  = nullptr;
+  unsigned*     sq_mask_  = nullptr;
+  unsigned*     sq_array_ = nullptr;
+  io_uring_sqe* sqes_     = nullptr;
+  unsigned*     cq_head_  = nullptr;
+  unsigned*     cq_tail_  = nullptr;
+  unsigned*     cq_mask_  = nullptr;
+  io_uring_cqe* cqes_     = nullptr;
+};
+
+} // namespace hibp
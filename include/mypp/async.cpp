@@ -0,0 +1,131 @@
+#include "async.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <poll.h>
+#include <stdexcept>
+#include <system_error>
+
+namespace mypp {
+
+// mypp::event_loop
+
+void event_loop::spawn(task<> t) {
+  tasks_.push_back(std::move(t));
+  tasks_.back().h_.resume();
+}
+
+void event_loop::add_waiter(wait_for& w, std::coroutine_handle<> h) {
+  short events = 0;
+  if ((w.status & MYSQL_WAIT_READ) != 0) events |= POLLIN;
+  if ((w.status & MYSQL_WAIT_WRITE) != 0) events |= POLLOUT;
+  if ((w.status & MYSQL_WAIT_EXCEPT) != 0) events |= POLLPRI;
+
+  std::optional<clock::time_point> deadline;
+  if ((w.status & MYSQL_WAIT_TIMEOUT) != 0)
+    deadline = clock::now() + std::chrono::milliseconds(::mysql_get_timeout_value_ms(w.con));
+
+  waiting_.push_back({::mysql_get_socket(w.con), events, deadline, &w, h});
+}
+
+void event_loop::run() {
+  std::vector<pollfd> fds;
+  std::vector<waiter> ready;
+  while (!waiting_.empty()) {
+    fds.clear();
+    auto timeout = -1; // ms, until the nearest deadline
+    auto now     = clock::now();
+    for (auto&& w: waiting_) {
+      fds.push_back({w.fd, w.events, 0});
+      if (w.deadline) {
+        auto ms = std::chrono::ceil<std::chrono::milliseconds>(*w.deadline - now).count();
+        ms      = std::max<decltype(ms)>(ms, 0);
+        if (timeout < 0 || ms < timeout) timeout = static_cast<int>(ms);
+      }
+    }
+
+    if (::poll(fds.data(), fds.size(), timeout) < 0) {
+      if (errno == EINTR) continue;
+      throw std::system_error(errno, std::generic_category(), "event_loop poll failed");
+    }
+
+    // take the ready waiters out first: resuming them adds new ones
+    now = clock::now();
+    ready.clear();
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < waiting_.size(); ++i) {
+      waiter& w       = waiting_[i];
+      short   revents = fds[i].revents;
+      int     status  = 0;
+      // errors and hangups are reported as readable, so the library finds out
+      if ((revents & (POLLIN | POLLERR | POLLHUP)) != 0) status |= MYSQL_WAIT_READ;
+      if ((revents & POLLOUT) != 0) status |= MYSQL_WAIT_WRITE;
+      if ((revents & POLLPRI) != 0) status |= MYSQL_WAIT_EXCEPT;
+      if (status == 0 && w.deadline && *w.deadline <= now) status = MYSQL_WAIT_TIMEOUT;
+
+      if (status != 0) {
+        w.wait->ready = status;
+        ready.push_back(w);
+      } else {
+        waiting_[kept++] = w;
+      }
+    }
+    waiting_.resize(kept);
+
+    for (auto&& w: ready) w.h.resume();
+  }
+
+  // nothing is waiting, so every task has finished, one way or the other
+  std::exception_ptr first_error;
+  for (auto&& t: tasks_)
+    if (!first_error && t.h_.promise().error) first_error = t.h_.promise().error;
+  tasks_.clear();
+  if (first_error) std::rethrow_exception(first_error);
+}
+
+// mypp::async_mysql
+
+async_mysql::async_mysql(event_loop& loop) : loop_(loop) {
+  if (::mysql_options(con_.mysql_, MYSQL_OPT_NONBLOCK, nullptr) != 0)
+    throw std::logic_error("couldn't set MYSQL_OPT_NONBLOCK: " + con_.error());
+}
+
+task<> async_mysql::connect(connect_options opts) {
+  if (!opts.charset.empty() &&
+      ::mysql_options(con_.mysql_, MYSQL_SET_CHARSET_NAME, opts.charset.c_str()) != 0)
+    throw std::logic_error("couldn't set mysql connection charset to: `" + opts.charset + "`");
+
+  MYSQL* ret    = nullptr;
+  int    status = ::mysql_real_connect_start(
+      &ret, con_.mysql_, opts.host.c_str(), opts.user.c_str(), opts.password.c_str(),
+      opts.db.c_str(), opts.port, opts.socket.empty() ? nullptr : opts.socket.c_str(), opts.flags);
+  while (status != 0) status = ::mysql_real_connect_cont(&ret, con_.mysql_, co_await wait(status));
+
+  if (ret == nullptr)
+    throw std::logic_error("failed to connect to " + opts.db + " on " + opts.host + " as user " +
+                           opts.user + ": " + con_.error());
+}
+
+task<result> async_mysql::query(std::string sql) {
+  int err    = 0;
+  int status = ::mysql_real_query_start(&err, con_.mysql_, sql.c_str(), sql.size());
+  while (status != 0) status = ::mysql_real_query_cont(&err, con_.mysql_, co_await wait(status));
+  if (err != 0) throw std::logic_error("mysql_real_query failed: " + con_.error());
+
+  MYSQL_RES* res = nullptr;
+  status         = ::mysql_store_result_start(&res, con_.mysql_);
+  while (status != 0) status = ::mysql_store_result_cont(&res, con_.mysql_, co_await wait(status));
+  if (res == nullptr)
+    throw std::logic_error("couldn't get results set for query: " + sql + "  Error was:" +
+                           con_.error());
+  co_return result(&con_, res);
+}
+
+task<std::uint64_t> async_mysql::execute(std::string sql) {
+  int err    = 0;
+  int status = ::mysql_real_query_start(&err, con_.mysql_, sql.c_str(), sql.size());
+  while (status != 0) status = ::mysql_real_query_cont(&err, con_.mysql_, co_await wait(status));
+  if (err != 0) throw std::logic_error("mysql_real_query failed: " + con_.error());
+  co_return ::mysql_affected_rows(con_.mysql_);
+}
+
+} // namespace mypp
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "mypp.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Non-blocking queries with C++20 coroutines, using MariaDB Connector/C's _start / _cont calls.
+// A single thread runs an event_loop, which keeps any number of async_mysql connections busy at
+// once: while one waits on the network the others proceed. Each connection runs one query at a
+// time, so queries which should overlap need a connection each.
+//
+//   mypp::event_loop loop;
+//   auto count = [&](mypp::async_mysql& con, std::string table) -> mypp::task<> {
+//     co_await con.connect(opts);
+//     auto rs = co_await con.query("select count(*) from " + table);
+//     std::cout << table << ": " << rs.fetch_row().get<long>(0) << "\n";
+//   };
+//   mypp::async_mysql a(loop), b(loop);
+//   loop.spawn(count(a, "member"));
+//   loop.spawn(count(b, "order_lineitem"));
+//   loop.run(); // both queries in flight together
+//
+// Everything here must be used on the thread which calls run().
+
+namespace mypp {
+
+namespace impl {
+
+template <typename T>
+struct task_result {
+  std::optional<T> value;
+  void             return_value(T v) { value.emplace(std::move(v)); }
+  T                take() { return std::move(*value); }
+};
+
+template <>
+struct task_result<void> {
+  void return_void() {}
+  void take() {}
+};
+
+} // namespace impl
+
+// A lazy coroutine producing T: it starts when co_await'ed, or when given to
+// event_loop::spawn(), and resumes its awaiter when done. Exceptions propagate to the awaiter.
+template <typename T = void>
+class task {
+public:
+  struct promise_type : impl::task_result<T> {
+    std::coroutine_handle<> continuation; // the awaiting coroutine, if any
+    std::exception_ptr      error;
+
+    task get_return_object() {
+      return task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto c = h.promise().continuation;
+        return c ? c : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  task(const task& m) = delete;
+  task& operator=(const task& other) = delete;
+
+  task(task&& other) noexcept : h_(std::exchange(other.h_, nullptr)) {}
+  task& operator=(task&& other) noexcept {
+    std::swap(h_, other.h_);
+    return *this;
+  }
+
+  ~task() {
+    if (h_) h_.destroy();
+  }
+
+  [[nodiscard]] bool done() const { return !h_ || h_.done(); }
+
+  // the result of a task which is done(), or its exception
+  T get() {
+    if (h_.promise().error) std::rethrow_exception(h_.promise().error);
+    return h_.promise().take();
+  }
+
+  auto operator co_await() && noexcept {
+    struct awaiter {
+      std::coroutine_handle<promise_type> h;
+
+      bool                    await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h.promise().continuation = awaiting;
+        return h; // start it, by symmetric transfer
+      }
+      T await_resume() {
+        if (h.promise().error) std::rethrow_exception(h.promise().error);
+        return h.promise().take();
+      }
+    };
+    return awaiter{h_};
+  }
+
+private:
+  friend class event_loop;
+  explicit task(std::coroutine_handle<promise_type> h) : h_(h) {}
+
+  std::coroutine_handle<promise_type> h_;
+};
+
+// Runs coroutines which wait on async_mysql connections, multiplexing their sockets with poll().
+class event_loop {
+public:
+  event_loop() = default;
+
+  event_loop(const event_loop& m) = delete;
+  event_loop& operator=(const event_loop& other) = delete;
+
+  event_loop(event_loop&& other) noexcept = delete;
+  event_loop& operator=(event_loop&& other) noexcept = delete;
+
+  ~event_loop() = default;
+
+  // Start t, which runs until its first wait, and keep it until run() finishes.
+  void spawn(task<> t);
+
+  // Wait for and resume connections until every spawned task is done, then rethrow the first
+  // exception any of them threw.
+  void run();
+
+  // Suspends until the connection's socket is ready for what status asks, as returned by a
+  // mysql_*_start or _cont call. Gives the status to pass to the next _cont call.
+  struct wait_for {
+    event_loop& loop;
+    MYSQL*      con;
+    int         status;
+    int         ready = 0;
+
+    bool await_ready() noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) { loop.add_waiter(*this, h); }
+    int  await_resume() noexcept { return ready; }
+  };
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct waiter {
+    int                              fd;
+    short                            events;
+    std::optional<clock::time_point> deadline;
+    wait_for*                        wait;
+    std::coroutine_handle<>          h;
+  };
+
+  void add_waiter(wait_for& w, std::coroutine_handle<> h);
+
+  std::vector<waiter> waiting_;
+  std::vector<task<>> tasks_;
+};
+
+// A connection in non-blocking mode, whose calls are coroutines run by an event_loop. The
+// blocking API remains available via sync(), but would hold up every coroutine of the loop.
+class async_mysql {
+public:
+  explicit async_mysql(event_loop& loop);
+
+  async_mysql(const async_mysql& m) = delete;
+  async_mysql& operator=(const async_mysql& other) = delete;
+
+  async_mysql(async_mysql&& other) noexcept = delete;
+  async_mysql& operator=(async_mysql&& other) noexcept = delete;
+
+  ~async_mysql() = default;
+
+  // opts.charset is set as an option before connecting, saving a round trip
+  task<> connect(connect_options opts);
+
+  // A query with a result set, which arrives in full before the task completes (as by
+  // mysql_store_result), so iterating it does not block.
+  task<result> query(std::string sql);
+
+  // a query without a result set, eg an insert. Gives the affected rows.
+  task<std::uint64_t> execute(std::string sql);
+
+  mysql& sync() { return con_; }
+
+private:
+  event_loop::wait_for wait(int status) { return {loop_, con_.mysql_, status}; }
+
+  event_loop& loop_;
+  mysql       con_;
+};
+
+} // namespace mypp
@@ -1,15 +1,24 @@
 #include "mypp.hpp"
+#include <algorithm>
+#include <errmsg.h>
 #include <stdexcept>
 #include <type_traits>
+#include <utility>
 
 namespace mypp {
 
 // mypp::mysql
 
 mysql::mysql() {
-  // in a multithreaded environment mysql_library_init should be protected by a mutex
-  if (mysql_library_init(0, nullptr, nullptr) != 0)
-    throw std::logic_error("mysql_library_init failed");
+  // mysql_library_init is not thread safe, and mysql_init calls it if it hasn't been, so do it
+  // once, here, under the static's guard. A failure throws, leaving it to be tried again.
+  static const bool library_initialised = []() {
+    if (::mysql_library_init(0, nullptr, nullptr) != 0)
+      throw std::logic_error("mysql_library_init failed");
+    return true;
+  }();
+  (void)library_initialised;
+
   mysql_ = ::mysql_init(mysql_);
   if (mysql_ == nullptr) throw std::logic_error("mysql_init failed");
 }
@@ -58,13 +67,12 @@ int mysql::get_max_allowed_packet() {
   return max_allowed_packet;
 }
 
-std::string mysql::quote(const char* in) {
-  // expensive to strlen and then allocate a std::string, but mysql_* api forces us?
-  std::size_t len = strlen(in);
+std::string mysql::quote(std::string_view in) {
+  std::size_t len = in.size();
   std::string out(len * 2 + 2, '\0');
   out[0] = '\''; // place leading quote
   std::size_t newlen =
-      ::mysql_real_escape_string(mysql_, &out[1], in, len); // leave leading quote in place
+      ::mysql_real_escape_string(mysql_, &out[1], in.data(), len); // leave leading quote in place
 
   if (newlen == static_cast<std::size_t>(-1)) {
     throw std::logic_error("mysql_real_escape_string failed: " + error());
@@ -97,6 +105,228 @@ std::vector<std::string> result::fieldnames() {
   return fieldnames;
 }
 
+unsigned result::field_index(std::string_view name) {
+  MYSQL_FIELD* fields = ::mysql_fetch_fields(myr);
+  for (unsigned i = 0; i < num_fields(); ++i)
+    if (fields[i].name == name) return i;
+  throw std::logic_error("field `" + std::string(name) + "` not in result");
+}
+
+// mypp::string_arena
+
+void string_arena::grow(std::size_t at_least) {
+  // reuse the first block after a clear(), else start a new one
+  if (!blocks_.empty() && next_ == nullptr && at_least <= first_size_) {
+    next_ = blocks_.front().get();
+    left_ = first_size_;
+    return;
+  }
+  std::size_t size = std::max(block_size_, at_least); // a long string gets a block of its own
+  blocks_.push_back(std::make_unique_for_overwrite<char[]>(size));
+  if (blocks_.size() == 1) first_size_ = size;
+  next_ = blocks_.back().get();
+  left_ = size;
+}
+
+void string_arena::clear() {
+  if (blocks_.size() > 1) blocks_.erase(blocks_.begin() + 1, blocks_.end());
+  next_ = nullptr;
+  left_ = 0;
+}
+
+// mypp::statement
+
+statement::statement(mysql& con, const std::string& sql) : stmt_(::mysql_stmt_init(con.mysql_)) {
+  if (stmt_ == nullptr) throw std::logic_error("mysql_stmt_init failed: " + con.error());
+  if (::mysql_stmt_prepare(stmt_, sql.c_str(), sql.size()) != 0) {
+    std::string err = error();
+    ::mysql_stmt_close(stmt_);
+    throw std::logic_error("mysql_stmt_prepare failed: " + err + " for: " + sql);
+  }
+
+  // parameters are NULL until bound
+  params_.resize(::mysql_stmt_param_count(stmt_));
+  param_binds_.resize(params_.size()); // zeroed
+  for (std::size_t i = 0; i < params_.size(); ++i) {
+    params_[i].is_null          = 1;
+    param_binds_[i].buffer_type = MYSQL_TYPE_NULL;
+    param_binds_[i].is_null     = &params_[i].is_null;
+    param_binds_[i].length      = &params_[i].length;
+  }
+}
+
+// Only a change of type or buffer needs mysql_stmt_bind_param again: values, including the
+// lengths of strings, are read from the buffers on every execute.
+void statement::set_param(unsigned idx, enum_field_types type, void* buffer, unsigned long length,
+                          bool is_unsigned) {
+  MYSQL_BIND& b = param_binds_[idx];
+  if (b.buffer_type != type || b.buffer != buffer || (b.is_unsigned != 0) != is_unsigned)
+    params_changed_ = true;
+  b.buffer_type       = type;
+  b.buffer            = buffer;
+  b.buffer_length     = length;
+  b.is_unsigned       = is_unsigned ? 1 : 0;
+  params_[idx].length = length;
+}
+
+void statement::execute_bound() {
+  if (params_changed_ && !params_.empty() &&
+      ::mysql_stmt_bind_param(stmt_, param_binds_.data()) != 0)
+    throw std::logic_error("mysql_stmt_bind_param failed: " + error());
+  params_changed_ = false;
+
+  ::mysql_stmt_free_result(stmt_); // any rows left from last time
+  if (::mysql_stmt_execute(stmt_) != 0)
+    throw std::logic_error("mysql_stmt_execute failed: " + error());
+
+  if (cols_.empty() && ::mysql_stmt_field_count(stmt_) > 0) bind_columns();
+}
+
+void statement::bind_columns() {
+  MYSQL_RES* meta = ::mysql_stmt_result_metadata(stmt_);
+  if (meta == nullptr) throw std::logic_error("mysql_stmt_result_metadata failed: " + error());
+  unsigned     n      = ::mysql_num_fields(meta);
+  MYSQL_FIELD* fields = ::mysql_fetch_fields(meta);
+
+  cols_.resize(n);
+  col_binds_.resize(n); // zeroed
+  for (unsigned i = 0; i < n; ++i) {
+    const MYSQL_FIELD& f   = fields[i];
+    column&            col = cols_[i];
+    MYSQL_BIND&        b   = col_binds_[i];
+
+    switch (f.type) {
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_YEAR:
+      col.type        = MYSQL_TYPE_LONGLONG;
+      col.is_unsigned = (f.flags & UNSIGNED_FLAG) != 0;
+      b.buffer        = &col.integer;
+      b.buffer_length = sizeof(col.integer);
+      b.is_unsigned   = col.is_unsigned ? 1 : 0;
+      break;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+      col.type        = MYSQL_TYPE_DOUBLE;
+      b.buffer        = &col.real;
+      b.buffer_length = sizeof(col.real);
+      break;
+    case MYSQL_TYPE_DATE:
+    case MYSQL_TYPE_DATETIME:
+    case MYSQL_TYPE_TIMESTAMP:
+      col.type        = f.type == MYSQL_TYPE_DATE ? MYSQL_TYPE_DATE : MYSQL_TYPE_DATETIME;
+      b.buffer        = &col.time;
+      b.buffer_length = sizeof(col.time);
+      break;
+    default: // strings, blobs, enums, DECIMAL (exact), TIME etc as text. fetch() grows the buffer
+      col.type = MYSQL_TYPE_STRING;
+      col.text.resize(std::clamp(f.length, 1UL, 1024UL));
+      b.buffer        = col.text.data();
+      b.buffer_length = col.text.size();
+      break;
+    }
+    b.buffer_type = col.type;
+    b.is_null     = &col.is_null;
+    b.length      = &col.length;
+    b.error       = &col.error;
+  }
+  ::mysql_free_result(meta);
+
+  if (::mysql_stmt_bind_result(stmt_, col_binds_.data()) != 0)
+    throw std::logic_error("mysql_stmt_bind_result failed: " + error());
+}
+
+bool statement::fetch() {
+  int rc = ::mysql_stmt_fetch(stmt_);
+  if (rc == MYSQL_NO_DATA) return false;
+  if (rc == 1) throw std::logic_error("mysql_stmt_fetch failed: " + error());
+
+  if (rc == MYSQL_DATA_TRUNCATED) {
+    // grow the buffers which were too small, and fetch those columns again
+    for (unsigned i = 0; i < cols_.size(); ++i) {
+      column&     col = cols_[i];
+      MYSQL_BIND& b   = col_binds_[i];
+      if (col.error == 0 || col.type != MYSQL_TYPE_STRING) continue;
+      col.text.resize(col.length);
+      b.buffer        = col.text.data();
+      b.buffer_length = col.text.size();
+      if (::mysql_stmt_fetch_column(stmt_, &b, i, 0) != 0)
+        throw std::logic_error("mysql_stmt_fetch_column failed: " + error());
+    }
+    if (::mysql_stmt_bind_result(stmt_, col_binds_.data()) != 0)
+      throw std::logic_error("mysql_stmt_bind_result failed: " + error());
+  }
+  return true;
+}
+
+// mypp::pool
+
+pool::pool(connect_options opts, std::size_t size, std::chrono::milliseconds ping_after)
+    : opts_(std::move(opts)), size_(size), ping_after_(ping_after) {
+  if (size_ == 0) throw std::logic_error("pool needs at least one connection");
+  idle_.reserve(size_);
+  for (std::size_t i = 0; i < size_; ++i) idle_.push_back({connect(), clock::now()});
+}
+
+std::unique_ptr<mysql> pool::connect() const {
+  auto con = std::make_unique<mysql>();
+  con->connect(opts_.host, opts_.user, opts_.password, opts_.db, opts_.port, opts_.socket,
+               opts_.flags);
+  if (!opts_.charset.empty()) con->set_character_set(opts_.charset);
+  return con;
+}
+
+pool::lease pool::acquire() {
+  std::unique_lock lock(mutex_);
+  available_.wait(lock, [this] { return !idle_.empty(); });
+  slot s = std::move(idle_.back());
+  idle_.pop_back();
+  lock.unlock();
+  return checkout(std::move(s));
+}
+
+std::optional<pool::lease> pool::try_acquire() {
+  std::unique_lock lock(mutex_);
+  if (idle_.empty()) return std::nullopt;
+  slot s = std::move(idle_.back());
+  idle_.pop_back();
+  lock.unlock();
+  return checkout(std::move(s));
+}
+
+// health check and any reconnect happen outside the lock, so a slow server holds up only the
+// thread which got that connection
+pool::lease pool::checkout(slot s) {
+  try {
+    if (s.con == nullptr || (clock::now() - s.since > ping_after_ && !s.con->ping()))
+      s.con = connect();
+  } catch (...) {
+    release(nullptr); // keep the slot, to try again next time
+    throw;
+  }
+  return {this, std::move(s.con)};
+}
+
+void pool::release(std::unique_ptr<mysql> con) {
+  if (con != nullptr) {
+    auto err = con->errnumber();
+    if (err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST) con.reset(); // reconnect on acquire
+  }
+  {
+    std::lock_guard lock(mutex_);
+    idle_.push_back({std::move(con), clock::now()});
+  }
+  available_.notify_one();
+}
+
+std::size_t pool::idle() const {
+  std::lock_guard lock(mutex_);
+  return idle_.size();
+}
+
 // free functions
 
 std::string quote_identifier(const std::string& identifier) {
@@ -4,14 +4,25 @@
 #include "fmt/core.h"
 #include "os/str.hpp"
 #include "os/tmp.hpp"
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <mysql.h>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <type_traits>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace mypp {
@@ -19,6 +30,33 @@ namespace mypp {
 class mysql;
 class result;
 class row;
+class statement;
+class pool;
+class async_mysql;
+
+// Maps a column of a result, by name, or by position if name is empty, to a member of Class.
+//   mypp::field{"email", &member::email}
+template <typename Class, typename Member>
+struct field {
+  using type = Member;
+
+  constexpr field(std::string_view name_, Member Class::*member_) : name(name_), member(member_) {}
+  constexpr explicit field(Member Class::*member_) : member(member_) {}
+
+  std::string_view name;
+  Member Class::*member;
+};
+
+// Specialise for a struct to load results into it with result::as<T>(), giving a tuple of
+// field{}s in `fields`. Named fields are looked up once per result set and may be in any order,
+// unnamed ones take the column at their position in the tuple.
+//
+//   template <>
+//   struct mypp::row_map<member> {
+//     static constexpr auto fields = std::tuple{mypp::field{"email", &member::email}, ...};
+//   };
+template <typename T>
+struct row_map;
 
 // the result set obtained from a query. Wrapper for MYSQL_RES.
 class result {
@@ -28,7 +66,8 @@ public:
   result(const result& m) = delete;
   result& operator=(const result& other) = delete;
 
-  result(result&& other) noexcept = delete;
+  // for async_mysql::query's task. Rows already fetched still refer to other, which is left empty.
+  result(result&& other) noexcept : mysql(other.mysql), myr(std::exchange(other.myr, nullptr)) {}
   result& operator=(result&& other) noexcept = delete;
 
   ~result() { ::mysql_free_result(myr); }
@@ -46,6 +85,15 @@ public:
   Iterator begin();
   Iterator end();
 
+  // All remaining rows, each decoded into a T as described by row_map<T>. Columns are matched to
+  // members once, and each cell is parsed straight into its member with the parser for that
+  // member's type, without going through row::get. reserve is the expected number of rows.
+  template <typename T>
+  std::vector<T> as(std::size_t reserve = 0);
+
+  // of the field called name, throws if there is none
+  unsigned field_index(std::string_view name);
+
 private:
   mysql*     mysql;
   MYSQL_RES* myr;
@@ -152,8 +200,95 @@ inline NumericType parse(const char* str, std::size_t len) {
   }
 }
 
+// types which would point into a row's buffer, which is reused by the next row and freed with the
+// result, so can't be kept
+template <typename T>
+constexpr bool is_dangling_type = std::is_same_v<T, const char*> ||
+                                  std::is_same_v<T, std::string_view> ||
+                                  std::is_same_v<T, std::optional<std::string_view>>;
+
+template <typename T>
+constexpr bool is_string_type =
+    std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+// parse plus std::string and std::string_view, made from the length the server sent
+template <typename ValueType>
+inline ValueType decode(const char* str, std::size_t len) {
+  if constexpr (os::tmp::is_optional<ValueType>::value) {
+    using InnerType = std::remove_reference_t<decltype(std::declval<ValueType>().value())>;
+    if constexpr (is_string_type<InnerType>) {
+      if (str == nullptr) return std::nullopt;
+      return InnerType(str, len);
+    } else {
+      return parse<ValueType>(str, len);
+    }
+  } else if constexpr (is_string_type<ValueType>) {
+    if (str == nullptr)
+      throw std::domain_error("requested type was not std::optional, but db returned NULL");
+    return ValueType(str, len);
+  } else {
+    return parse<ValueType>(str, len);
+  }
+}
+
 } // namespace impl
 
+// Holds copies of strings in large blocks: one allocation per block rather than one per string.
+// The views it returns are valid until the arena is destroyed or clear()'ed. For keeping text
+// from rows which must outlive them, when a std::string each would be too many mallocs.
+class string_arena {
+public:
+  explicit string_arena(std::size_t block_size = 64UL * 1024) : block_size_(block_size) {}
+
+  string_arena(const string_arena& m) = delete;
+  string_arena& operator=(const string_arena& other) = delete;
+
+  // the views already returned stay valid, now owned by the new arena. other is left empty.
+  string_arena(string_arena&& other) noexcept
+      : block_size_(other.block_size_), blocks_(std::move(other.blocks_)),
+        first_size_(std::exchange(other.first_size_, 0)),
+        next_(std::exchange(other.next_, nullptr)), left_(std::exchange(other.left_, 0)) {
+    other.blocks_.clear();
+  }
+  string_arena& operator=(string_arena&& other) noexcept {
+    if (this != &other) {
+      block_size_ = other.block_size_;
+      blocks_     = std::move(other.blocks_); // frees ours
+      other.blocks_.clear();
+      first_size_ = std::exchange(other.first_size_, 0);
+      next_       = std::exchange(other.next_, nullptr);
+      left_       = std::exchange(other.left_, 0);
+    }
+    return *this;
+  }
+
+  ~string_arena() = default;
+
+  // a copy of s, owned by the arena
+  std::string_view store(std::string_view s) {
+    if (s.size() > left_ || next_ == nullptr) grow(s.size());
+    char* p = next_;
+    std::memcpy(p, s.data(), s.size());
+    next_ += s.size();
+    left_ -= s.size();
+    return {p, s.size()};
+  }
+
+  // forget every string, keeping the first block for reuse
+  void clear();
+
+  [[nodiscard]] std::size_t blocks() const { return blocks_.size(); }
+
+private:
+  void grow(std::size_t at_least);
+
+  std::size_t                          block_size_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  std::size_t                          first_size_ = 0; // of blocks_[0]
+  char*                                next_       = nullptr;
+  std::size_t                          left_       = 0;
+};
+
 // representing one row of a resultset. Wrapper for MYSQL_ROW
 class row {
 public:
@@ -167,6 +302,18 @@ public:
     return std::vector<std::string>(row_, row_ + rs->num_fields());
   }
 
+  // every cell copied into arena, which must outlive the views. NULL gives a view with a nullptr
+  // data().
+  [[nodiscard]] std::vector<std::string_view> vector(string_arena& arena) const {
+    std::vector<std::string_view> cells;
+    cells.reserve(rs->num_fields());
+    std::size_t* lens = rs->lengths();
+    for (unsigned i = 0; i < rs->num_fields(); ++i)
+      cells.push_back(row_[i] == nullptr ? std::string_view{}
+                                         : arena.store(std::string_view(row_[i], lens[i])));
+    return cells;
+  }
+
   [[nodiscard]] char* operator[](unsigned idx) const { return row_[idx]; }
 
   [[nodiscard]] char* at(unsigned idx) const {
@@ -176,16 +323,18 @@ public:
 
   [[nodiscard]] std::size_t len(unsigned idx) const { return rs->lengths()[idx]; }
 
+  // std::string takes a copy. std::string_view does not: it refers to the row's buffer, so is
+  // valid only until the next fetch_row() on this result. Beware lifetimes! Both use len(idx),
+  // so binary data is intact. Anything else is parsed, eg as a number or date.
   template <typename ValueType = std::string>
   [[nodiscard]] ValueType get(unsigned idx) const {
-    // try numeric parsing by default
-    return impl::parse<ValueType>((*this)[idx], len(idx));
+    return impl::decode<ValueType>((*this)[idx], len(idx));
   }
 
-  // takes a copy in a std::string
-  template <>
-  [[nodiscard]] std::string get<std::string>(unsigned idx) const {
-    return (*this)[idx]; // converting constructor
+  // The raw bytes of a cell, eg a BLOB, with the same lifetime as get<std::string_view>. NULL
+  // and empty both give an empty span.
+  [[nodiscard]] std::span<const std::byte> bytes(unsigned idx) const {
+    return {reinterpret_cast<const std::byte*>((*this)[idx]), len(idx)}; // NOLINT reincast
   }
 
   // access to the raw const char*, potentially for external parsing
@@ -251,6 +400,9 @@ public:
 
   std::string get_host_info();
 
+  // true if the connection is alive. Does not reconnect.
+  bool ping() { return ::mysql_ping(mysql_) == 0; }
+
   result query(const std::string& sql, bool expect_result = true);
 
   std::vector<std::string> single_row(const std::string& sql);
@@ -258,8 +410,11 @@ public:
   // throws if row not found
   template <typename ValueType>
   ValueType single_value(const std::string& sql, unsigned col = 0) {
-    static_assert(!std::is_same_v<ValueType, const char*>,
-                  "single_value<const char*> will result in dangling pointers");
+    static_assert(!std::is_same_v<ValueType, const char*> &&
+                      !std::is_same_v<ValueType, std::string_view> &&
+                      !std::is_same_v<ValueType, std::optional<std::string_view>>,
+                  "single_value<const char*> or <std::string_view> will result in dangling "
+                  "pointers");
     auto rs  = query(sql);
     auto row = rs.fetch_row();
     if (row.empty()) throw std::logic_error("single row not found by: " + sql);
@@ -273,8 +428,11 @@ public:
     ContainerType values;
     auto          rs = query(sql);
     using ValueType  = typename ContainerType::value_type;
-    static_assert(!std::is_same_v<ValueType, const char*>,
-                  "single_column<Container<const char*>> will result in dangling pointers");
+    static_assert(!std::is_same_v<ValueType, const char*> &&
+                      !std::is_same_v<ValueType, std::string_view> &&
+                      !std::is_same_v<ValueType, std::optional<std::string_view>>,
+                  "single_column<Container<const char*>> or <std::string_view> will result in "
+                  "dangling pointers");
     for (auto&& row: rs) {
       if constexpr (os::tmp::has_push_back<ContainerType>::value)
         values.push_back(row.get<ValueType>(col));
@@ -285,7 +443,8 @@ public:
   }
 
   int         get_max_allowed_packet();
-  std::string quote(const char* in);
+  std::string quote(std::string_view in);
+  std::string quote(const char* in) { return quote(std::string_view(in)); }
 
   unsigned    errnumber() { return ::mysql_errno(mysql_); }
   std::string error() { return ::mysql_error(mysql_); }
@@ -294,9 +453,195 @@ public:
   void rollback() { query("rollback", false); }
 
 private:
+  friend class statement;
+  friend class async_mysql;
+
   MYSQL* mysql_ = nullptr;
 };
 
+// A prepared statement using the binary protocol: parameters and columns travel as typed values,
+// so numbers and dates are neither formatted nor parsed as text. Parameter bindings are kept
+// across executions, as are the column buffers, which grow to fit the longest string seen.
+// Wrapper for MYSQL_STMT.
+//
+//   mypp::statement st(con, "select id, description from order_lineitem where order_id = ?");
+//   st.execute(order_id);
+//   while (st.fetch()) use(st.get<int>(0), st.get<std::string>(1));
+class statement {
+public:
+  statement(mysql& con, const std::string& sql);
+
+  statement(const statement& m) = delete;
+  statement& operator=(const statement& other) = delete;
+
+  statement(statement&& other) noexcept = delete;
+  statement& operator=(statement&& other) noexcept = delete;
+
+  ~statement() { ::mysql_stmt_close(stmt_); }
+
+  [[nodiscard]] unsigned param_count() const { return static_cast<unsigned>(params_.size()); }
+  [[nodiscard]] unsigned num_fields() const { return static_cast<unsigned>(cols_.size()); }
+
+  // Set parameter idx (0-based) for this and later executions. ValueType is an integral or
+  // floating point type, std::string, std::string_view, const char*, date::sys_days,
+  // date::sys_seconds, std::optional of one of those, or std::nullptr_t for NULL. The value is
+  // copied, so it need not outlive the call.
+  template <typename ValueType>
+  void bind(unsigned idx, const ValueType& value);
+
+  // Bind params to parameters 0, 1, ... if any are given, then execute. Rows of the previous
+  // execution which were not fetched are discarded.
+  template <typename... Params>
+  void execute(const Params&... params) {
+    unsigned idx = 0;
+    (bind(idx++, params), ...);
+    execute_bound();
+  }
+
+  // advance to the next row of the result, false when there are no more
+  bool fetch();
+
+  // Column idx of the current row, converted from its binary value. Integer and floating point
+  // columns are fetched as int64 or double, DATE, DATETIME and TIMESTAMP as MYSQL_TIME, and the
+  // rest as text, including DECIMAL, which stays exact as a std::string and is parsed for a
+  // double. std::string_view refers into the column buffer: beware lifetimes, it is only valid
+  // until the next fetch().
+  template <typename ValueType = std::string>
+  [[nodiscard]] ValueType get(unsigned idx) const;
+
+  [[nodiscard]] std::uint64_t affected_rows() { return ::mysql_stmt_affected_rows(stmt_); }
+
+  std::string error() { return ::mysql_stmt_error(stmt_); }
+
+private:
+  struct param {
+    std::int64_t  integer = 0;
+    double        real    = 0.0;
+    MYSQL_TIME    time{};
+    std::string   text;
+    unsigned long length  = 0; // of text
+    my_bool       is_null = 0;
+  };
+
+  struct column {
+    enum_field_types  type; // as bound, which decides the member below in use
+    bool              is_unsigned = false;
+    std::int64_t      integer     = 0;
+    double            real        = 0.0;
+    MYSQL_TIME        time{};
+    std::vector<char> text;
+    unsigned long     length  = 0;
+    my_bool           is_null = 0;
+    my_bool           error   = 0;
+
+    [[nodiscard]] std::string_view view() const { return {text.data(), length}; }
+  };
+
+  void execute_bound();
+  void bind_columns();
+  void set_param(unsigned idx, enum_field_types type, void* buffer, unsigned long length,
+                 bool is_unsigned = false);
+
+  MYSQL_STMT*             stmt_ = nullptr;
+  std::vector<param>      params_;
+  std::vector<MYSQL_BIND> param_binds_; // point into params_, which is never resized
+  bool                    params_changed_ = true;
+  std::vector<column>     cols_;
+  std::vector<MYSQL_BIND> col_binds_; // point into cols_, which is never resized
+};
+
+// what mysql::connect() and mysql::set_character_set() are called with by pool
+struct connect_options {
+  std::string   host = "localhost";
+  std::string   user{};
+  std::string   password{};
+  std::string   db{};
+  unsigned      port = 0;
+  std::string   socket{};
+  std::uint64_t flags = 0UL;
+  std::string   charset{}; // empty = server default
+};
+
+// A fixed set of connections, all made up front, shared between threads. acquire() hands one
+// out as a lease, blocking while all are in use, and the lease puts it back when destroyed. A
+// connection which has been idle for a while is pinged before it is handed out, and replaced if
+// that fails, as is one whose last error was a lost connection. Each connection is used by one
+// thread at a time, so mysql, result and statement need no locking of their own.
+//
+//   mypp::pool pool({.user = "u", .password = "p", .db = "shop"}, 8);
+//   auto con = pool.acquire();
+//   auto n   = con->single_value<int>("select count(*) from member");
+//
+// The pool must outlive its leases.
+class pool {
+public:
+  using clock = std::chrono::steady_clock;
+
+  // RAII handle for one connection of the pool
+  class lease {
+  public:
+    lease(const lease& m) = delete;
+    lease& operator=(const lease& other) = delete;
+
+    lease(lease&& other) noexcept : pool_(other.pool_), con_(std::move(other.con_)) {
+      other.pool_ = nullptr;
+    }
+    lease& operator=(lease&& other) noexcept = delete;
+
+    ~lease() {
+      if (pool_ != nullptr) pool_->release(std::move(con_));
+    }
+
+    mysql& operator*() const { return *con_; }
+    mysql* operator->() const { return con_.get(); }
+
+  private:
+    friend class pool;
+    lease(pool* p, std::unique_ptr<mysql> con) : pool_(p), con_(std::move(con)) {}
+
+    pool*                  pool_;
+    std::unique_ptr<mysql> con_;
+  };
+
+  pool(connect_options opts, std::size_t size,
+       std::chrono::milliseconds ping_after = std::chrono::seconds(1));
+
+  pool(const pool& m) = delete;
+  pool& operator=(const pool& other) = delete;
+
+  pool(pool&& other) noexcept = delete;
+  pool& operator=(pool&& other) noexcept = delete;
+
+  ~pool() = default;
+
+  // blocks until a connection is free. Throws if a dead one cannot be replaced.
+  lease acquire();
+
+  // nullopt if none is free right now
+  std::optional<lease> try_acquire();
+
+  [[nodiscard]] std::size_t size() const { return size_; }
+  [[nodiscard]] std::size_t idle() const;
+
+private:
+  struct slot {
+    std::unique_ptr<mysql> con; // nullptr if it died and must be reconnected
+    clock::time_point      since;
+  };
+
+  [[nodiscard]] std::unique_ptr<mysql> connect() const;
+
+  lease checkout(slot s);
+  void  release(std::unique_ptr<mysql> con);
+
+  connect_options           opts_;
+  std::size_t               size_;
+  std::chrono::milliseconds ping_after_;
+  mutable std::mutex        mutex_;
+  std::condition_variable   available_;
+  std::vector<slot>         idle_; // a stack: the most recently used is the most likely alive
+};
+
 std::string quote_identifier(const std::string& identifier);
 
 namespace impl {
@@ -341,4 +686,173 @@ std::string format_time_point(TimePointType tp) {
   return out;
 }
 
+namespace impl {
+
+inline bool is_zero_date(const MYSQL_TIME& t) { return t.year == 0 && t.month == 0 && t.day == 0; }
+
+template <typename TimePointType>
+TimePointType from_mysql_time(const MYSQL_TIME& t) {
+  date::year_month_day ymd = {date::year(static_cast<int>(t.year)), date::month(t.month),
+                              date::day(t.day)};
+  if (!ymd.ok())
+    throw std::domain_error(fmt::format("invalid date {:04}-{:02}-{:02}", t.year, t.month, t.day));
+
+  auto date_tp = date::sys_days{ymd};
+  if constexpr (std::is_same_v<TimePointType, date::sys_days>) {
+    return date_tp;
+  } else {
+    return date_tp + std::chrono::hours(t.hour) + std::chrono::minutes(t.minute) +
+           std::chrono::seconds(t.second);
+  }
+}
+
+template <typename TimePointType>
+MYSQL_TIME to_mysql_time(TimePointType tp) {
+  auto                 today = floor<date::days>(tp);
+  date::year_month_day ymd   = today;
+
+  MYSQL_TIME t{};
+  t.year  = static_cast<unsigned>(int{ymd.year()});
+  t.month = unsigned{ymd.month()};
+  t.day   = unsigned{ymd.day()};
+  if constexpr (std::is_same_v<TimePointType, date::sys_seconds>) {
+    date::hh_mm_ss hms{tp - today};
+    t.hour      = static_cast<unsigned>(hms.hours().count());
+    t.minute    = static_cast<unsigned>(hms.minutes().count());
+    t.second    = static_cast<unsigned>(hms.seconds().count());
+    t.time_type = MYSQL_TIMESTAMP_DATETIME;
+  } else {
+    t.time_type = MYSQL_TIMESTAMP_DATE;
+  }
+  return t;
+}
+
+} // namespace impl
+
+// mypp::result templates
+
+template <typename T>
+std::vector<T> result::as(std::size_t reserve) {
+  constexpr auto& fields = row_map<T>::fields;
+  using fields_type      = std::remove_cvref_t<decltype(fields)>;
+  constexpr auto size    = std::tuple_size_v<fields_type>;
+  using indices          = std::make_index_sequence<size>;
+
+  constexpr bool dangling = []<std::size_t... I>(std::index_sequence<I...>) {
+    return (impl::is_dangling_type<typename std::tuple_element_t<I, fields_type>::type> || ...);
+  }(indices{});
+  static_assert(!dangling, "row_map members of type const char* or std::string_view will result "
+                           "in dangling pointers");
+
+  std::array<unsigned, size> cols{};
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    ((cols[I] = std::get<I>(fields).name.empty() ? unsigned{I}
+                                                 : field_index(std::get<I>(fields).name)),
+     ...);
+  }(indices{});
+  for (auto col: cols)
+    if (col >= num_fields())
+      throw std::logic_error("result has no column " + std::to_string(col) + " for row_map");
+
+  std::vector<T> out;
+  out.reserve(reserve);
+  while (MYSQL_ROW r = ::mysql_fetch_row(myr)) {
+    std::size_t* lens = lengths();
+    T&           t    = out.emplace_back();
+    [&]<std::size_t... I>(std::index_sequence<I...>) {
+      ((t.*(std::get<I>(fields).member) =
+            impl::decode<typename std::remove_cvref_t<decltype(std::get<I>(fields))>::type>(
+                r[cols[I]], lens[cols[I]])),
+       ...);
+    }(indices{});
+  }
+  if (mysql->errnumber() != 0) throw std::logic_error("mysql_fetch_row failed:" + mysql->error());
+  return out;
+}
+
+// mypp::statement templates
+
+template <typename ValueType>
+void statement::bind(unsigned idx, const ValueType& value) {
+  if (idx >= params_.size())
+    throw std::logic_error("statement has no parameter " + std::to_string(idx));
+  param& p  = params_[idx];
+  p.is_null = 0;
+
+  if constexpr (std::is_same_v<ValueType, std::nullptr_t> ||
+                std::is_same_v<ValueType, std::nullopt_t>) {
+    p.is_null = 1;
+    set_param(idx, MYSQL_TYPE_NULL, nullptr, 0);
+  } else if constexpr (os::tmp::is_optional<ValueType>::value) {
+    if (value)
+      bind(idx, *value);
+    else
+      bind(idx, nullptr);
+  } else if constexpr (std::is_same_v<ValueType, date::sys_days> ||
+                       std::is_same_v<ValueType, date::sys_seconds>) {
+    p.time = impl::to_mysql_time(value);
+    set_param(idx,
+              std::is_same_v<ValueType, date::sys_days> ? MYSQL_TYPE_DATE : MYSQL_TYPE_DATETIME,
+              &p.time, sizeof(p.time));
+  } else if constexpr (std::is_integral_v<ValueType>) {
+    p.integer = static_cast<std::int64_t>(value);
+    set_param(idx, MYSQL_TYPE_LONGLONG, &p.integer, sizeof(p.integer),
+              std::is_unsigned_v<ValueType>);
+  } else if constexpr (std::is_floating_point_v<ValueType>) {
+    p.real = static_cast<double>(value);
+    set_param(idx, MYSQL_TYPE_DOUBLE, &p.real, sizeof(p.real));
+  } else {
+    static_assert(std::is_convertible_v<const ValueType&, std::string_view>,
+                  "don't know how to bind this parameter type");
+    p.text   = std::string_view(value);
+    p.length = p.text.size();
+    set_param(idx, MYSQL_TYPE_STRING, p.text.data(), p.length);
+  }
+}
+
+template <typename ValueType>
+ValueType statement::get(unsigned idx) const {
+  const column& col = cols_[idx];
+  bool          is_time = col.type == MYSQL_TYPE_DATE || col.type == MYSQL_TYPE_DATETIME;
+
+  if constexpr (os::tmp::is_optional<ValueType>::value) {
+    using InnerType = std::remove_reference_t<decltype(std::declval<ValueType>().value())>;
+    if (col.is_null != 0 || (is_time && impl::is_zero_date(col.time))) return std::nullopt;
+    return get<InnerType>(idx); // unwrap and recurse
+  } else {
+    if (col.is_null != 0)
+      throw std::domain_error("requested type was not std::optional, but db returned NULL");
+
+    if constexpr (std::is_same_v<ValueType, std::string_view>) {
+      if (col.type != MYSQL_TYPE_STRING)
+        throw std::logic_error("std::string_view requested for non text column " +
+                               std::to_string(idx));
+      return col.view();
+    } else if constexpr (std::is_same_v<ValueType, std::string>) {
+      switch (col.type) {
+      case MYSQL_TYPE_LONGLONG:
+        return col.is_unsigned ? std::to_string(static_cast<std::uint64_t>(col.integer))
+                               : std::to_string(col.integer);
+      case MYSQL_TYPE_DOUBLE: return fmt::format("{}", col.real);
+      case MYSQL_TYPE_DATE: return format_time_point(get<date::sys_days>(idx));
+      case MYSQL_TYPE_DATETIME: return format_time_point(get<date::sys_seconds>(idx));
+      default: return std::string(col.view());
+      }
+    } else if constexpr (std::is_same_v<ValueType, date::sys_days> ||
+                         std::is_same_v<ValueType, date::sys_seconds>) {
+      if (!is_time)
+        throw std::logic_error("date requested for non date column " + std::to_string(idx));
+      return impl::from_mysql_time<ValueType>(col.time);
+    } else {
+      static_assert(std::is_arithmetic_v<ValueType>,
+                    "don't know how to convert a column to this type");
+      if (col.type == MYSQL_TYPE_LONGLONG)
+        return col.is_unsigned ? static_cast<ValueType>(static_cast<std::uint64_t>(col.integer))
+                               : static_cast<ValueType>(col.integer);
+      if (col.type == MYSQL_TYPE_DOUBLE) return static_cast<ValueType>(col.real);
+      return impl::parse<ValueType>(std::string(col.view()).c_str(), col.length); // eg ENUM
+    }
+  }
+}
+
 } // namespace mypp
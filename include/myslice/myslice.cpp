@@ -50,19 +50,20 @@ std::ostream& operator<<(std::ostream& os, const field& f) {
 
 // use a std::string as tmp buffer, most numeric values are very small so this is fast
 // and a std::string has to be created inside mypp::mysql::quote() anyway
-std::string field::quote(const char* unquoted) const {
+std::string field::quote(std::optional<std::string_view> unquoted) const {
 
-  if (unquoted == nullptr) return "NULL";
+  if (!unquoted) return "NULL";
 
   if (nullable && fk != nullptr && fk->foreign_field.restricted_values_ &&
-      !fk->foreign_field.restricted_values_->contains(os::str::parse<int>(unquoted)))
+      !fk->foreign_field.restricted_values_->contains(
+          os::str::parse<int>(unquoted->data(), unquoted->size())))
     return "NULL"; // maintain referential intergrity
 
   switch (quoting_type) {
   case field::qtype::string:
-    return con().quote(unquoted);
+    return con().quote(*unquoted); // no strlen: the length comes from the row
   case field::qtype::numeric:
-    return unquoted;
+    return std::string(*unquoted);
   }
 }
 
@@ -320,7 +321,7 @@ void table::dump(std::ostream& os) {
     row_sql.clear();
     row_sql << "(";
     for (auto&& [i, f]: fm) {
-      row_sql << f->quote(row[i]);
+      row_sql << f->quote(row.get<std::optional<std::string_view>>(i));
       if (i == fm.size() - 1)
         row_sql << ")";
       else
@@ -43,7 +43,7 @@ public:
   bool is_pk() const;
 
   std::string sql_where_clause(const std::unordered_set<int>& values) const;
-  std::string quote(const char* unquoted) const;
+  std::string quote(std::optional<std::string_view> unquoted) const; // nullopt for NULL
 
   std::ostream&        vprint(std::ostream& os);
   friend std::ostream& operator<<(std::ostream& os, const field& f);